@@ -0,0 +1,307 @@
+#include <vector>
+#include <cmath>
+#include <string>
+#include <iostream>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Reads one numeric column of a CSV file straight from a memory mapping.
+ *
+ * Field boundaries are found 16 bytes at a time with SSE2 and values are
+ * parsed in place, correctly rounded and independently of the locale (see
+ * parseDouble()). Nothing is copied out of the mapping but the parsed doubles.
+ *
+ * isEmpty()/nextLine() behave like the other CSVReader variants; nextBatch()
+ * is the fast path.
+ */
+class CSVReader
+{
+    std::string filename;
+    char delimeter;
+    size_t column;
+    const char *data;
+    size_t length;
+    /** Start of the next line to read. */
+    const char *cursor;
+    const char *end;
+    double doublevalue;
+
+    /**
+     * Returns the first occurrence of a or b in [p, last), or last.
+     */
+    static const char *findAny(const char *p, const char *last, char a, char b)
+    {
+#ifdef __SSE2__
+        const __m128i va = _mm_set1_epi8(a);
+        const __m128i vb = _mm_set1_epi8(b);
+        while (last - p >= 16)
+        {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)));
+            if (mask != 0)
+                return p + __builtin_ctz(mask);
+            p += 16;
+        }
+#endif
+        while (p < last && *p != a && *p != b)
+            p++;
+        return p;
+    }
+
+    /**
+     * Parses a decimal number at p, returning its end or nullptr if there is
+     * none. Numbers with at most 15 significant digits and a power of ten up
+     * to 1e22 take Clinger's fast path: both factors are exact doubles, so one
+     * multiplication or division rounds correctly. Anything else goes to
+     * std::from_chars.
+     */
+    static const char *parseDouble(const char *p, const char *last, double &value)
+    {
+        static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        const char *start = p;
+        bool negative = p < last && *p == '-';
+        if (negative)
+            p++;
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        const char *first = p;
+        while (p < last && (unsigned)(*p - '0') < 10)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+            p++;
+        }
+        if (p < last && *p == '.')
+        {
+            p++;
+            while (p < last && (unsigned)(*p - '0') < 10)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+                p++;
+            }
+        }
+        if (p == first || (p == first + 1 && *first == '.'))
+            return nullptr;
+        if ((p < last && (*p == 'e' || *p == 'E')) || digits > 15 || exponent < -22)
+        {
+            auto result = std::from_chars(start, last, value);
+            return result.ec == std::errc() ? result.ptr : nullptr;
+        }
+
+        value = exponent == 0 ? (double)mantissa : (double)mantissa / powers[-exponent];
+        if (negative)
+            value = -value;
+        return p;
+    }
+
+    /**
+     * Parses columns cols[0] < cols[1] < ... of the line at p into outs[k][row]
+     * and returns the start of the next line. Missing columns and fields that
+     * are not numbers give missing().
+     */
+    const char *parseColumns(const char *p, const size_t *cols, size_t ncols, double *const *outs, size_t row) const
+    {
+        size_t field = 0;
+        for (size_t k = 0; k < ncols; k++)
+        {
+            while (field < cols[k])
+            {
+                p = findAny(p, end, delimeter, '\n');
+                if (p == end || *p == '\n')
+                {
+                    for (; k < ncols; k++)
+                        outs[k][row] = missing();
+                    return p == end ? end : p + 1;
+                }
+                p++;
+                field++;
+            }
+
+            while (p < end && *p == ' ')
+                p++;
+            if (p < end && *p == '+')
+                p++;
+            const char *parsed = parseDouble(p, end, outs[k][row]);
+            if (parsed == nullptr)
+                outs[k][row] = missing();
+            else
+                p = parsed;
+        }
+
+        p = (const char *)memchr(p, '\n', end - p);
+        return p == nullptr ? end : p + 1;
+    }
+
+    /**
+     * Parses the selected column of the line at p into value and returns the
+     * start of the next line.
+     */
+    const char *parseLine(const char *p, double &value) const
+    {
+        double *out = &value;
+        return parseColumns(p, &column, 1, &out, 0);
+    }
+
+public:
+    /**
+     * The value of missing and unparsable fields: a quiet NaN with a payload,
+     * as the plain NaN ends ChimpN streams and sends its blocks to the raw codec.
+     */
+    static double missing()
+    {
+        const uint64_t bits = 0x7ff8000000000001ULL;
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    CSVReader(std::string f, std::string del = ",", size_t col = 2) : filename(f), delimeter(del[0]), column(col)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0)
+        {
+            std::cout << "Unable to open file";
+            exit(1); // terminate with error
+        }
+
+        length = st.st_size;
+        data = nullptr;
+        if (length > 0)
+        {
+            void *map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED)
+            {
+                std::cout << "Unable to map file";
+                exit(1);
+            }
+            madvise(map, length, MADV_SEQUENTIAL);
+            data = (const char *)map;
+        }
+        close(fd);
+        cursor = data;
+        end = data + length;
+    };
+
+    CSVReader(const CSVReader &) = delete;
+    CSVReader &operator=(const CSVReader &) = delete;
+
+    /**
+     * Reads the next line; true once the file or an empty line is reached.
+     */
+    bool isEmpty()
+    {
+        if (cursor == end || *cursor == '\n' || *cursor == '\r')
+            return true;
+        cursor = parseLine(cursor, doublevalue);
+        return false;
+    }
+
+    double nextLine()
+    {
+        return doublevalue;
+    }
+
+    /**
+     * Parses up to max values of the column into out, stopping at the end of
+     * the file or at an empty line.
+     *
+     * @return the number of values parsed.
+     */
+    size_t nextBatch(double *out, size_t max)
+    {
+        size_t n = 0;
+        while (n < max && cursor != end && *cursor != '\n' && *cursor != '\r')
+            cursor = parseLine(cursor, out[n++]);
+        return n;
+    }
+
+    /**
+     * Parses up to max rows, storing column cols[k] of each in outs[k]; cols
+     * must be ascending. Empty lines are skipped.
+     *
+     * @return the number of rows parsed.
+     */
+    size_t nextRows(const size_t *cols, size_t ncols, double *const *outs, size_t max)
+    {
+        size_t n = 0;
+        while (n < max && cursor < end)
+        {
+            if (*cursor == '\n' || *cursor == '\r')
+                cursor++;
+            else
+                cursor = parseColumns(cursor, cols, ncols, outs, n++);
+        }
+        return n;
+    }
+
+    /**
+     * Splits the next line into its fields, for header rows.
+     */
+    std::vector<std::string> nextFields()
+    {
+        std::vector<std::string> fields;
+        const char *eol = (const char *)memchr(cursor, '\n', end - cursor);
+        const char *last = eol == nullptr ? end : eol;
+        if (last > cursor && last[-1] == '\r')
+            last--;
+        while (cursor <= last)
+        {
+            const char *p = findAny(cursor, last, delimeter, delimeter);
+            fields.emplace_back(cursor, p);
+            cursor = p + 1;
+        }
+        cursor = eol == nullptr ? end : eol + 1;
+        return fields;
+    }
+
+    /** The mapped file, for callers splitting it into ranges. */
+    const char *mapping() const
+    {
+        return data;
+    }
+
+    size_t mappingSize() const
+    {
+        return length;
+    }
+
+    /**
+     * Parses up to max values from the lines starting in [p, last) into out,
+     * skipping empty lines, and moves p past them. A line starting before last
+     * is parsed whole, so ranges must start at line boundaries.
+     *
+     * @return the number of values parsed.
+     */
+    size_t parseRange(const char *&p, const char *last, double *out, size_t max) const
+    {
+        size_t n = 0;
+        while (n < max && p < last)
+        {
+            if (*p == '\n' || *p == '\r')
+                p++;
+            else
+                p = parseLine(p, out[n++]);
+        }
+        return n;
+    }
+
+    ~CSVReader()
+    {
+        if (data != nullptr)
+            munmap((void *)data, length);
+    }
+};
@@ -0,0 +1,295 @@
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <ostream>
+#include <sstream>
+#include <istream>
+#include <iterator>
+#include <algorithm>
+#include "ChimpMappedInput.cpp"
+#include "CSVReader-mmap.cpp"
+#include "chimp-datasets.h"
+
+/**
+ * Statistics of repeated measurements, in the unit of the samples.
+ */
+struct ChimpBenchStats
+{
+    size_t n = 0;
+    double min = 0;
+    double median = 0;
+    double mean = 0;
+    double stddev = 0;
+
+    static ChimpBenchStats of(std::vector<double> samples)
+    {
+        ChimpBenchStats s;
+        s.n = samples.size();
+        if (s.n == 0)
+            return s;
+        std::sort(samples.begin(), samples.end());
+        s.min = samples[0];
+        s.median = s.n % 2 == 1 ? samples[s.n / 2] : (samples[s.n / 2 - 1] + samples[s.n / 2]) / 2;
+        for (double v : samples)
+            s.mean += v;
+        s.mean /= s.n;
+        for (double v : samples)
+            s.stddev += (v - s.mean) * (v - s.mean);
+        s.stddev = s.n > 1 ? sqrt(s.stddev / (s.n - 1)) : 0;
+        return s;
+    }
+};
+
+/*
+ * Runs f warmup times untimed, then reps times on the monotonic clock.
+ * ret: the seconds each timed run took.
+ */
+template <typename F>
+static std::vector<double>
+chimp_bench_time(F f, int warmup, int reps)
+{
+    std::vector<double> seconds;
+    for (int i = 0; i < warmup; i++)
+        f();
+    for (int i = 0; i < reps; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return seconds;
+}
+
+/**
+ * One result line: named fields, kept in the order they were added.
+ */
+struct ChimpBenchRow
+{
+    std::vector<std::pair<std::string, std::string>> fields;
+    std::vector<bool> numeric;
+
+    ChimpBenchRow &add(const std::string &name, const std::string &value)
+    {
+        fields.emplace_back(name, value);
+        numeric.push_back(false);
+        return *this;
+    }
+
+    ChimpBenchRow &add(const std::string &name, double value)
+    {
+        std::ostringstream s;
+        s.precision(10);
+        s << value;
+        fields.emplace_back(name, std::isfinite(value) ? s.str() : "null");
+        numeric.push_back(true);
+        return *this;
+    }
+
+    /** Adds name_median, name_mean, name_stddev and name_min. */
+    ChimpBenchRow &add(const std::string &name, const ChimpBenchStats &s)
+    {
+        add(name + "_median", s.median);
+        add(name + "_mean", s.mean);
+        add(name + "_stddev", s.stddev);
+        return add(name + "_min", s.min);
+    }
+
+    /** The value of field name, or an empty string. */
+    std::string get(const std::string &name) const
+    {
+        for (auto &f : fields)
+        {
+            if (f.first == name)
+                return f.second;
+        }
+        return "";
+    }
+};
+
+/**
+ * Collects rows and writes them as an aligned table, CSV or a JSON array.
+ * CSV takes its columns from the first row.
+ */
+struct ChimpBenchReport
+{
+    std::vector<ChimpBenchRow> rows;
+
+    static std::string quote(const std::string &s)
+    {
+        std::string q = "\"";
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+                q += '\\';
+            q += c;
+        }
+        return q + "\"";
+    }
+
+    /**
+     * Reads back rows written as JSON, appending them to rows.
+     * @return false if the input is not an array of flat objects.
+     */
+    bool read(std::istream &in)
+    {
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        const char *p = text.c_str();
+        auto skip = [&]()
+        {
+            while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t' || *p == ',')
+                p++;
+        };
+        auto quoted = [&](std::string &s)
+        {
+            s.clear();
+            for (p++; *p != '"'; p++)
+            {
+                if (*p == '\0')
+                    return false;
+                if (*p == '\\' && p[1] != '\0')
+                    p++;
+                s += *p;
+            }
+            p++;
+            return true;
+        };
+
+        skip();
+        if (*p++ != '[')
+            return false;
+        for (skip(); *p == '{'; skip())
+        {
+            ChimpBenchRow row;
+            for (p++, skip(); *p == '"'; skip())
+            {
+                std::string name, value;
+                if (!quoted(name))
+                    return false;
+                skip();
+                if (*p++ != ':')
+                    return false;
+                skip();
+                if (*p == '"')
+                {
+                    if (!quoted(value))
+                        return false;
+                    row.add(name, value);
+                    continue;
+                }
+                const char *start = p;
+                while (*p && *p != ',' && *p != '}' && *p != ' ' && *p != '\n')
+                    p++;
+                value.assign(start, p);
+                if (value.empty())
+                    return false;
+                row.fields.emplace_back(name, value);
+                row.numeric.push_back(true);
+            }
+            if (*p++ != '}')
+                return false;
+            rows.push_back(row);
+        }
+        return *p == ']';
+    }
+
+    void write(std::ostream &out, const std::string &format) const
+    {
+        if (format == "json")
+        {
+            out << "[\n";
+            for (size_t r = 0; r < rows.size(); r++)
+            {
+                out << "  {";
+                for (size_t f = 0; f < rows[r].fields.size(); f++)
+                {
+                    const auto &field = rows[r].fields[f];
+                    out << (f > 0 ? ", " : "") << quote(field.first) << ": "
+                        << (rows[r].numeric[f] ? field.second : quote(field.second));
+                }
+                out << "}" << (r + 1 < rows.size() ? "," : "") << "\n";
+            }
+            out << "]\n";
+        }
+        else if (format == "csv")
+        {
+            if (rows.empty())
+                return;
+            for (size_t f = 0; f < rows[0].fields.size(); f++)
+                out << (f > 0 ? "," : "") << rows[0].fields[f].first;
+            out << "\n";
+            for (auto &row : rows)
+            {
+                for (size_t f = 0; f < rows[0].fields.size(); f++)
+                    out << (f > 0 ? "," : "") << row.get(rows[0].fields[f].first);
+                out << "\n";
+            }
+        }
+        else
+        {
+            if (rows.empty())
+                return;
+            std::vector<size_t> widths;
+            for (auto &f : rows[0].fields)
+                widths.push_back(f.first.size());
+            for (auto &row : rows)
+            {
+                for (size_t f = 0; f < widths.size(); f++)
+                    widths[f] = std::max(widths[f], row.get(rows[0].fields[f].first).size());
+            }
+            for (size_t f = 0; f < widths.size(); f++)
+            {
+                out << rows[0].fields[f].first << std::string(widths[f] - rows[0].fields[f].first.size() + 2, ' ');
+            }
+            out << "\n";
+            for (auto &row : rows)
+            {
+                for (size_t f = 0; f < widths.size(); f++)
+                {
+                    std::string v = row.get(rows[0].fields[f].first);
+                    out << v << std::string(widths[f] - v.size() + 2, ' ');
+                }
+                out << "\n";
+            }
+        }
+    }
+};
+
+/*
+ * Fills values with a dataset: nvalues generated by the CHIMP_DATASETS entry
+ * called spec, the given column of file.csv[:column] (2 by default) or a file
+ * of raw little-endian doubles.
+ * ret: false if the file cannot be read.
+ */
+inline bool
+chimp_bench_load(const std::string &spec, std::vector<double> &values, size_t nvalues, uint64_t seed)
+{
+    const ChimpDataset *generator = chimp_find_dataset(spec.c_str());
+    if (generator != nullptr)
+    {
+        generator->generate(values, nvalues, seed);
+        return true;
+    }
+
+    std::string path = spec;
+    size_t column = 2;
+    size_t colon = spec.rfind(':');
+    if (colon != std::string::npos && colon > spec.rfind('/') + 1)
+    {
+        path = spec.substr(0, colon);
+        column = atoi(spec.c_str() + colon + 1);
+    }
+    if (path.size() > 4 && path.substr(path.size() - 4) == ".csv")
+    {
+        CSVReader reader(path, ",", column);
+        const char *p = reader.mapping();
+        values.resize(reader.mappingSize() / 2 + 1);
+        values.resize(reader.parseRange(p, p + reader.mappingSize(), values.data(), values.size()));
+        return true;
+    }
+    ChimpMappedInput input(path);
+    if (!input.valid())
+        return false;
+    values.assign((const double *)input.data, (const double *)input.data + input.nvalues);
+    return true;
+}
@@ -0,0 +1,292 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "chimp-unit.h"
+
+/*
+ * A columnar file holds several series of the same length, cut into row
+ * groups of up to a few thousand rows. Every column of a row group is one
+ * compressed block, so each block picks its own codec (see
+ * chimp_compress_data), and a footer lists every block and per column
+ * statistics:
+ *
+ *   "CHMPCOL1"
+ *   blocks, in row group order then column order
+ *   footer:
+ *     uint32_t ncols, uint32_t nrowgroups
+ *     per column: uint16_t name length, name, ChimpColumnStats
+ *     per row group: uint32_t nrows, then per column uint64_t offset, uint32_t size
+ *   uint64_t footer offset
+ *   "CHMPCOL1"
+ *
+ * Reading a column touches the footer and that column's blocks only.
+ */
+#define CHIMP_COLUMN_MAGIC "CHMPCOL1"
+#define CHIMP_COLUMN_MAGIC_SIZE 8
+
+struct ChimpColumnStats
+{
+    uint64_t nvalues = 0;
+    /** NaN values, which min, max and sum leave out. */
+    uint64_t nnan = 0;
+    double min = INFINITY;
+    double max = -INFINITY;
+    double sum = 0;
+    /** Compressed bytes of the column's blocks. */
+    uint64_t bytes = 0;
+};
+
+struct ChimpColumnBlock
+{
+    uint64_t offset;
+    uint32_t size;
+};
+
+/**
+ * Writes a columnar file a row group at a time, in one pass.
+ */
+struct ChimpColumnWriter
+{
+    std::ofstream out;
+    std::vector<std::string> names;
+    std::vector<ChimpColumnStats> stats;
+    std::vector<uint32_t> rowgroups;
+    /** blocks[g * ncols + c] is column c of row group g. */
+    std::vector<ChimpColumnBlock> blocks;
+    std::vector<char> buffer;
+    uint64_t offset;
+
+    ChimpColumnWriter(const std::string &filename, const std::vector<std::string> &columnNames)
+        : out(filename, std::ios::out | std::ios::binary), names(columnNames), stats(columnNames.size())
+    {
+        out.write(CHIMP_COLUMN_MAGIC, CHIMP_COLUMN_MAGIC_SIZE);
+        offset = CHIMP_COLUMN_MAGIC_SIZE;
+    }
+
+    bool good() const
+    {
+        return out.good();
+    }
+
+    /**
+     * Compresses and writes a row group; columns[c] holds the nrows values of
+     * column c.
+     */
+    bool addRowGroup(const double *const *columns, uint32_t nrows)
+    {
+        buffer.resize(CHIMP_COMPRESS_BOUND(nrows * 8));
+        for (size_t c = 0; c < names.size(); c++)
+        {
+            int32_t size = chimp_compress_data((const char *)columns[c], nrows * 8, buffer.data(), buffer.size());
+            if (size < 0)
+                return false;
+            out.write(buffer.data(), size);
+            blocks.push_back({offset, (uint32_t)size});
+            offset += size;
+
+            ChimpColumnStats &s = stats[c];
+            s.nvalues += nrows;
+            s.bytes += size;
+            for (uint32_t i = 0; i < nrows; i++)
+            {
+                double v = columns[c][i];
+                if (std::isnan(v))
+                {
+                    s.nnan++;
+                    continue;
+                }
+                s.min = v < s.min ? v : s.min;
+                s.max = v > s.max ? v : s.max;
+                s.sum += v;
+            }
+        }
+        rowgroups.push_back(nrows);
+        return out.good();
+    }
+
+    /**
+     * Writes the footer and closes the file.
+     */
+    bool close()
+    {
+        uint64_t footer = offset;
+        uint32_t ncols = names.size();
+        uint32_t ngroups = rowgroups.size();
+        out.write((const char *)&ncols, sizeof(ncols));
+        out.write((const char *)&ngroups, sizeof(ngroups));
+        for (size_t c = 0; c < ncols; c++)
+        {
+            uint16_t length = names[c].size();
+            out.write((const char *)&length, sizeof(length));
+            out.write(names[c].data(), length);
+            out.write((const char *)&stats[c], sizeof(ChimpColumnStats));
+        }
+        for (size_t g = 0; g < ngroups; g++)
+        {
+            out.write((const char *)&rowgroups[g], sizeof(uint32_t));
+            for (size_t c = 0; c < ncols; c++)
+            {
+                out.write((const char *)&blocks[g * ncols + c].offset, sizeof(uint64_t));
+                out.write((const char *)&blocks[g * ncols + c].size, sizeof(uint32_t));
+            }
+        }
+        out.write((const char *)&footer, sizeof(footer));
+        out.write(CHIMP_COLUMN_MAGIC, CHIMP_COLUMN_MAGIC_SIZE);
+        out.close();
+        return !out.fail();
+    }
+};
+
+/**
+ * Reads columns of a columnar file through a memory mapping.
+ */
+struct ChimpColumnReader
+{
+    const char *data = nullptr;
+    size_t length = 0;
+    bool valid = false;
+    std::vector<std::string> names;
+    std::vector<ChimpColumnStats> stats;
+    std::vector<uint32_t> rowgroups;
+    std::vector<ChimpColumnBlock> blocks;
+
+    ChimpColumnReader(const std::string &filename)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0)
+            return;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED)
+            {
+                data = (const char *)map;
+                length = st.st_size;
+            }
+        }
+        ::close(fd);
+        if (data != nullptr)
+            valid = readFooter();
+    }
+
+    ChimpColumnReader(const ChimpColumnReader &) = delete;
+    ChimpColumnReader &operator=(const ChimpColumnReader &) = delete;
+
+    ~ChimpColumnReader()
+    {
+        if (data != nullptr)
+            munmap((void *)data, length);
+    }
+
+    bool readFooter()
+    {
+        const size_t trailer = sizeof(uint64_t) + CHIMP_COLUMN_MAGIC_SIZE;
+        if (length < CHIMP_COLUMN_MAGIC_SIZE + trailer ||
+            memcmp(data, CHIMP_COLUMN_MAGIC, CHIMP_COLUMN_MAGIC_SIZE) != 0 ||
+            memcmp(data + length - CHIMP_COLUMN_MAGIC_SIZE, CHIMP_COLUMN_MAGIC, CHIMP_COLUMN_MAGIC_SIZE) != 0)
+            return false;
+
+        uint64_t footer;
+        memcpy(&footer, data + length - trailer, sizeof(footer));
+        const char *p = data + footer;
+        const char *end = data + length - trailer;
+        if (footer > length - trailer || end - p < 8)
+            return false;
+
+        uint32_t ncols, ngroups;
+        memcpy(&ncols, p, sizeof(ncols));
+        memcpy(&ngroups, p + 4, sizeof(ngroups));
+        p += 8;
+        for (uint32_t c = 0; c < ncols; c++)
+        {
+            uint16_t namelength;
+            if (end - p < (ptrdiff_t)sizeof(namelength))
+                return false;
+            memcpy(&namelength, p, sizeof(namelength));
+            p += sizeof(namelength);
+            if (end - p < (ptrdiff_t)(namelength + sizeof(ChimpColumnStats)))
+                return false;
+            names.emplace_back(p, namelength);
+            p += namelength;
+            stats.emplace_back();
+            memcpy(&stats.back(), p, sizeof(ChimpColumnStats));
+            p += sizeof(ChimpColumnStats);
+        }
+
+        const size_t entry = sizeof(uint64_t) + sizeof(uint32_t);
+        if ((size_t)(end - p) != ngroups * (sizeof(uint32_t) + ncols * entry))
+            return false;
+        uint64_t nrowsTotal = 0;
+        for (uint32_t g = 0; g < ngroups; g++)
+        {
+            uint32_t nrows;
+            memcpy(&nrows, p, sizeof(nrows));
+            if ((uint64_t)nrows * 8 > UINT32_MAX)
+                return false;
+            rowgroups.push_back(nrows);
+            nrowsTotal += nrows;
+            p += sizeof(nrows);
+            for (uint32_t c = 0; c < ncols; c++, p += entry)
+            {
+                ChimpColumnBlock b;
+                memcpy(&b.offset, p, sizeof(b.offset));
+                memcpy(&b.size, p + sizeof(b.offset), sizeof(b.size));
+                if (b.offset > footer || b.size > footer - b.offset)
+                    return false;
+                blocks.push_back(b);
+            }
+        }
+        // Readers size their output from nvalues, so it must match the row groups.
+        for (uint32_t c = 0; c < ncols; c++)
+        {
+            if (stats[c].nvalues != nrowsTotal)
+                return false;
+        }
+        return true;
+    }
+
+    size_t ncols() const
+    {
+        return names.size();
+    }
+
+    /**
+     * Returns the index of the column called name, or -1.
+     */
+    int column(const std::string &name) const
+    {
+        for (size_t c = 0; c < names.size(); c++)
+        {
+            if (names[c] == name)
+                return c;
+        }
+        return -1;
+    }
+
+    /**
+     * Decodes column c into out, which must hold stats[c].nvalues values.
+     * ret: the number of values, or a negative ENCODING_* error.
+     */
+    int64_t readColumn(size_t c, double *out) const
+    {
+        uint64_t n = 0;
+        for (size_t g = 0; g < rowgroups.size(); g++)
+        {
+            const ChimpColumnBlock &b = blocks[g * names.size() + c];
+            int32_t ret = chimp_decompress_data(data + b.offset, b.size, (char *)(out + n), rowgroups[g] * 8);
+            if (ret < 0)
+                return ret;
+            if ((uint32_t)ret != rowgroups[g] * 8)
+                return ENCODING_CORRUPTED_DATA;
+            n += rowgroups[g];
+        }
+        return n;
+    }
+};
@@ -0,0 +1,197 @@
+#include <vector>
+#include <atomic>
+#include <functional>
+#include "chimp-unit.h"
+
+#if defined(__SANITIZE_THREAD__)
+#define CHIMP_TSAN
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define CHIMP_TSAN
+#endif
+#endif
+
+#ifdef CHIMP_TSAN
+extern "C" void AnnotateIgnoreReadsBegin(const char *file, int line);
+extern "C" void AnnotateIgnoreReadsEnd(const char *file, int line);
+#define CHIMP_IGNORE_READS_BEGIN() AnnotateIgnoreReadsBegin(__FILE__, __LINE__)
+#define CHIMP_IGNORE_READS_END() AnnotateIgnoreReadsEnd(__FILE__, __LINE__)
+#else
+#define CHIMP_IGNORE_READS_BEGIN()
+#define CHIMP_IGNORE_READS_END()
+#endif
+
+/**
+ * A block compressed as values arrive, which other threads can read while it
+ * is being written.
+ *
+ * Unlike ChimpStreamWriter, which buffers raw values and picks a window per
+ * block, values go straight into a ChimpN of a fixed window, so there is no
+ * uncompressed copy of the hot block. After every value the writer publishes
+ * what a reader needs to decode the prefix written so far: the number of whole
+ * bytes, the partial byte, the value count and the pending run, which is not
+ * in the bit stream yet. They are published under a sequence lock: the writer
+ * never waits, and a reader retries if the writer moved on while it copied.
+ * Bytes below the published position never change until the block is sealed.
+ *
+ * Once it is sealed, the next block is written over the same bytes, which a
+ * reader of the old one may still be copying. That copy is a data race in the
+ * C++ memory model, if a benign one: the sequence lock discards it. The bytes
+ * are plain and not atomic because the encoder writes them, and C++17 has no
+ * atomic_ref to read them with; ThreadSanitizer is told to ignore the copy.
+ *
+ * There must be a single writer; any number of threads may call snapshot().
+ * A full block is sealed into a regular ChimpN block and handed to the sink.
+ */
+struct ChimpLiveBlock
+{
+    /** Receives each sealed block: its bytes (header included) and size. */
+    typedef std::function<void(const char *block, uint32_t size)> Sink;
+
+    Sink sink;
+    uint32_t maxItems;
+    /** Index in CHIMP_WINDOWS of the window blocks are encoded with. */
+    size_t window;
+    ChimpN enc;
+    const uint8_t *bytes;
+    /** Values in the block; only the writer uses it. */
+    uint32_t count = 0;
+    std::vector<char> out;
+
+    /** Odd while the writer publishes. */
+    std::atomic<uint32_t> seq{0};
+    std::atomic<int> publishedPos{0};
+    std::atomic<uint8_t> publishedPartial{0};
+    std::atomic<uint32_t> publishedCount{0};
+    std::atomic<uint32_t> publishedRun{0};
+    std::atomic<uint64_t> publishedRunValue{0};
+
+    ChimpLiveBlock(Sink preSink, uint32_t preMaxItems = 3600, size_t preWindow = 2)
+        : sink(preSink), maxItems(preMaxItems > 0 ? preMaxItems : 1),
+          enc(1 << CHIMP_WINDOWS[preWindow].windowLog2, maxItems, CHIMP_WINDOWS[preWindow].threshold, true),
+          out(CHIMP_HEADER_SIZE + 9 * maxItems + 32)
+    {
+        window = preWindow;
+        bytes = enc.getOut();
+    }
+
+    ChimpLiveBlock(const ChimpLiveBlock &) = delete;
+    ChimpLiveBlock &operator=(const ChimpLiveBlock &) = delete;
+
+    ~ChimpLiveBlock()
+    {
+        flush();
+    }
+
+    void append(double value)
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        if (bits == enc.NAN_LONG)
+        {
+            // ChimpN would take it for the terminator; it gets a block of its own.
+            flush();
+            int32_t size = chimp_compress_data((const char *)&value, sizeof(value), out.data(), out.size());
+            if (size > 0)
+                sink(out.data(), size);
+            return;
+        }
+        enc.addValue(bits);
+        count++;
+
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        publishedPos.store(enc.obs.pos, std::memory_order_relaxed);
+        publishedPartial.store((uint8_t)enc.obs.current, std::memory_order_relaxed);
+        publishedCount.store(count, std::memory_order_relaxed);
+        publishedRun.store(enc.runLength, std::memory_order_relaxed);
+        publishedRunValue.store(enc.runValue, std::memory_order_relaxed);
+        seq.store(s + 2, std::memory_order_release);
+
+        if (count == maxItems)
+            flush();
+    }
+
+    /**
+     * Seals the block, if it holds any value, and starts a new one.
+     */
+    void flush()
+    {
+        if (count == 0)
+            return;
+        enc.close();
+        char *writePos = out.data();
+        *((uint32_t *)(writePos)) = count;
+        writePos += sizeof(uint32_t);
+        *writePos++ = CHIMP_CODEC_CHIMPN;
+        *writePos++ = CHIMP_WINDOWS[window].windowLog2;
+        *writePos++ = CHIMP_WINDOWS[window].threshold;
+        *writePos++ = CHIMP_FLAG_RUNS;
+        memcpy(writePos, bytes, enc.obs.pos);
+        sink(out.data(), CHIMP_HEADER_SIZE + enc.obs.pos);
+
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        enc.reset();
+        count = 0;
+        publishedPos.store(0, std::memory_order_relaxed);
+        publishedPartial.store(0, std::memory_order_relaxed);
+        publishedCount.store(0, std::memory_order_relaxed);
+        publishedRun.store(0, std::memory_order_relaxed);
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    /**
+     * Decodes the values of the block written so far into values.
+     *
+     * @return the number of values.
+     */
+    uint32_t snapshot(std::vector<double> &values) const
+    {
+        // Room for the partial byte, and for the decoder reading a little past
+        // the last value.
+        const int padding = 16;
+        thread_local std::vector<uint8_t> prefix;
+        uint32_t s, n, run;
+        uint64_t runValue;
+        int pos;
+        uint8_t partial;
+
+        while (true)
+        {
+            s = seq.load(std::memory_order_acquire);
+            if (s & 1)
+                continue;
+            pos = publishedPos.load(std::memory_order_relaxed);
+            partial = publishedPartial.load(std::memory_order_relaxed);
+            n = publishedCount.load(std::memory_order_relaxed);
+            run = publishedRun.load(std::memory_order_relaxed);
+            runValue = publishedRunValue.load(std::memory_order_relaxed);
+            if (prefix.size() < (size_t)pos + padding)
+                prefix.resize(pos + padding);
+            CHIMP_IGNORE_READS_BEGIN();
+            memcpy(prefix.data(), bytes, pos);
+            CHIMP_IGNORE_READS_END();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) == s)
+                break;
+        }
+
+        values.resize(n);
+        if (n == 0)
+            return 0;
+        prefix[pos] = partial;
+        memset(prefix.data() + pos + 1, 0, padding - 1);
+        if (chimp_decode_chimpn((const char *)prefix.data(), pos + padding, n - run, CHIMP_WINDOWS[window].windowLog2, true,
+                                nullptr, (char *)values.data()) != n - run)
+        {
+            values.clear();
+            return 0;
+        }
+        uint64_t *tail = (uint64_t *)values.data() + n - run;
+        std::fill(tail, tail + run, runValue);
+        return n;
+    }
+};
@@ -0,0 +1,158 @@
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "chimp-unit.h"
+
+/**
+ * Reads a file of raw little-endian doubles or floats through a memory mapping,
+ * a block at a time.
+ *
+ * Doubles on a little-endian host are handed out in place, so compression reads
+ * straight from the page cache. Floats are widened, and doubles on a big-endian
+ * host byte-swapped, into one staging block that is reused for every block.
+ * Pages behind the cursor are dropped from the mapping as it moves on, so a
+ * multi-GB file is read with a flat memory footprint.
+ */
+struct ChimpMappedInput
+{
+    const char *data = nullptr;
+    size_t length = 0;
+    /** Bytes per input value: 8 for doubles, 4 for floats. */
+    int width;
+    /** Values in the file; a trailing partial value is ignored. */
+    size_t nvalues = 0;
+    /** Index of the next value to read. */
+    size_t cursor = 0;
+    /** Start of the pages not yet dropped. */
+    size_t released = 0;
+    std::vector<double> staging;
+
+    /** Pages are dropped in steps of this many bytes. */
+    static const size_t RELEASE_STEP = 16 << 20;
+
+    ChimpMappedInput(const std::string &filename, int preWidth = sizeof(double))
+    {
+        width = preWidth;
+        if (width != sizeof(double) && width != sizeof(float))
+            return;
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0)
+            return;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED)
+            {
+                madvise(map, st.st_size, MADV_SEQUENTIAL);
+                data = (const char *)map;
+                length = st.st_size;
+                nvalues = length / width;
+            }
+        }
+        ::close(fd);
+    }
+
+    ChimpMappedInput(const ChimpMappedInput &) = delete;
+    ChimpMappedInput &operator=(const ChimpMappedInput &) = delete;
+
+    ~ChimpMappedInput()
+    {
+        if (data != nullptr)
+            munmap((void *)data, length);
+    }
+
+    bool valid() const
+    {
+        return data != nullptr;
+    }
+
+    void rewind()
+    {
+        cursor = 0;
+        released = 0;
+    }
+
+    /**
+     * Points block at the next up to max values, as doubles. The values stay
+     * valid until the next call.
+     *
+     * @return the number of values, 0 at the end of the file.
+     */
+    uint32_t nextBlock(const char *&block, uint32_t max)
+    {
+        size_t n = nvalues - cursor < max ? nvalues - cursor : max;
+        const char *p = data + cursor * width;
+
+        if (width == sizeof(double) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+        {
+            block = p;
+        }
+        else
+        {
+            staging.resize(max);
+            for (size_t i = 0; i < n; i++)
+            {
+                if (width == sizeof(double))
+                {
+                    uint64_t bits;
+                    memcpy(&bits, p + i * 8, 8);
+                    bits = __builtin_bswap64(bits);
+                    memcpy(&staging[i], &bits, 8);
+                }
+                else
+                {
+                    uint32_t bits;
+                    memcpy(&bits, p + i * 4, 4);
+                    if (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+                        bits = __builtin_bswap32(bits);
+                    float f;
+                    memcpy(&f, &bits, 4);
+                    staging[i] = f;
+                }
+            }
+            block = (const char *)staging.data();
+        }
+
+        // The previous block is done with; drop whole steps behind it.
+        size_t consumed = cursor * width;
+        if (consumed - released >= RELEASE_STEP)
+        {
+            size_t upto = consumed & ~(size_t)(RELEASE_STEP - 1);
+            madvise((void *)(data + released), upto - released, MADV_DONTNEED);
+            released = upto;
+        }
+        cursor += n;
+        return n;
+    }
+};
+
+/*
+ * Compresses the rest of in into out as a block stream of blockItems values per
+ * block (see chimp_append_block). The output buffer is reused for every block.
+ * ret: the number of values written, or a negative ENCODING_* error.
+ */
+inline int64_t
+chimp_compress_mapped(ChimpMappedInput &in, std::ostream &out, uint32_t blockItems)
+{
+    std::vector<char> buffer(CHIMP_FRAME_SIZE + CHIMP_COMPRESS_BOUND(blockItems * 8));
+    int64_t total = 0;
+    const char *block;
+    uint32_t n;
+
+    while ((n = in.nextBlock(block, blockItems)) != 0)
+    {
+        int32_t size = chimp_compress_data(block, n * 8, buffer.data() + CHIMP_FRAME_SIZE, buffer.size() - CHIMP_FRAME_SIZE);
+        if (size < 0)
+            return size;
+        *((uint32_t *)buffer.data()) = size;
+        out.write(buffer.data(), CHIMP_FRAME_SIZE + size);
+        total += n;
+    }
+    return out.good() ? total : ENCODING_BUFFER_OVERFLOW;
+}
@@ -0,0 +1,202 @@
+#include <vector>
+#include <atomic>
+#include "chimp-unit.h"
+#include "ChimpThreadPool.cpp"
+
+/* Streams of fewer values are decoded on the calling thread. */
+#define CHIMP_PARALLEL_MIN_ITEMS (1 << 16)
+
+struct ChimpFrame
+{
+    /** The block, past its frame. */
+    const char *block;
+    uint32_t size;
+    uint32_t nitems;
+    /** Index of the block's first value in the decoded stream. */
+    size_t first;
+};
+
+/*
+ * Lists the blocks of a block stream with where their values go, reading only
+ * the frames and the item counts of the headers.
+ * ret: the number of values in the stream, or a negative ENCODING_* error.
+ */
+inline int64_t
+chimp_scan_stream(const char *stream, size_t size, std::vector<ChimpFrame> &frames)
+{
+    const char *end = stream + size;
+    size_t total = 0;
+
+    frames.clear();
+    while (stream < end)
+    {
+        if ((size_t)(end - stream) < CHIMP_FRAME_SIZE + CHIMP_HEADER_SIZE)
+            return ENCODING_CORRUPTED_DATA;
+        uint32_t blocksize = *((uint32_t *)(stream));
+        stream += CHIMP_FRAME_SIZE;
+        if (blocksize > (size_t)(end - stream) || blocksize < CHIMP_HEADER_SIZE)
+            return ENCODING_CORRUPTED_DATA;
+        uint32_t nitems = *((uint32_t *)(stream));
+        frames.push_back({stream, blocksize, nitems, total});
+        total += nitems;
+        stream += blocksize;
+    }
+    return total;
+}
+
+/*
+ * Decodes a block stream of independent blocks (no CHIMP_FLAG_CONTINUATION)
+ * into dest, which holds dest_items values. Blocks are spread over the pool
+ * and decode straight into their place in dest; small streams, or no pool,
+ * decode on the calling thread.
+ *
+ * ret: the number of values, or a negative ENCODING_* error.
+ */
+inline int64_t
+chimp_decompress_stream_parallel(const char *stream, size_t size, double *dest, size_t dest_items,
+                                 ChimpThreadPool *pool)
+{
+    std::vector<ChimpFrame> frames;
+    int64_t total = chimp_scan_stream(stream, size, frames);
+    if (total < 0)
+        return total;
+    if ((size_t)total > dest_items)
+        return ENCODING_BUFFER_OVERFLOW;
+
+    std::atomic<int32_t> error(0);
+    auto decode = [&](size_t b, int)
+    {
+        const ChimpFrame &f = frames[b];
+        if ((uint64_t)f.nitems * 8 > UINT32_MAX)
+        {
+            error = ENCODING_CORRUPTED_DATA;
+            return;
+        }
+        int32_t ret = chimp_decompress_data(f.block, f.size, (char *)(dest + f.first), f.nitems * 8);
+        if (ret < 0)
+            error = ret;
+    };
+
+    if (pool == nullptr || pool->size() == 1 || frames.size() < 2 || total < CHIMP_PARALLEL_MIN_ITEMS)
+    {
+        for (size_t b = 0; b < frames.size() && error == 0; b++)
+            decode(b, 0);
+    }
+    else
+    {
+        pool->parallelFor(frames.size(), decode);
+    }
+    return error != 0 ? error.load() : total;
+}
+
+/* Batched inputs are grouped until a group holds at least this many bytes. */
+#define CHIMP_BATCH_GROUP_BYTES (64 << 10)
+
+struct ChimpBatchInput
+{
+    const char *source;
+    uint32_t source_size;
+};
+
+struct ChimpBatchOutput
+{
+    char *dest;
+    uint32_t dst_size;
+    /** Set by the batch call: the output size, or a negative ENCODING_* error. */
+    int32_t result;
+};
+
+/*
+ * Cuts n inputs into runs of consecutive ones of at least
+ * CHIMP_BATCH_GROUP_BYTES, so that tiny inputs share a task; groups[g] is the
+ * first input of group g and groups.back() is n.
+ * ret: the total size of the inputs.
+ */
+static uint64_t
+chimp_group_batch(const ChimpBatchInput *inputs, size_t n, std::vector<size_t> &groups)
+{
+    uint64_t total = 0, group = 0;
+
+    groups.assign(1, 0);
+    for (size_t i = 0; i < n; i++)
+    {
+        total += inputs[i].source_size;
+        group += inputs[i].source_size;
+        if (group >= CHIMP_BATCH_GROUP_BYTES || i + 1 == n)
+        {
+            groups.push_back(i + 1);
+            group = 0;
+        }
+    }
+    return total;
+}
+
+/*
+ * Runs op(i, worker) for every input, a group at a time, over the pool, or on
+ * the calling thread for small batches or without a pool.
+ * ret: 0, or the error of the first failed input.
+ */
+template <typename Op>
+static int32_t
+chimp_run_batch(const ChimpBatchInput *inputs, ChimpBatchOutput *outputs, size_t n, ChimpThreadPool *pool, Op op)
+{
+    std::vector<size_t> groups;
+    uint64_t total = chimp_group_batch(inputs, n, groups);
+
+    auto run = [&](size_t g, int worker)
+    {
+        for (size_t i = groups[g]; i < groups[g + 1]; i++)
+            outputs[i].result = op(i, worker);
+    };
+    if (pool == nullptr || pool->size() == 1 || groups.size() < 3 || total < CHIMP_PARALLEL_MIN_ITEMS * 8)
+    {
+        for (size_t g = 0; g + 1 < groups.size(); g++)
+            run(g, 0);
+    }
+    else
+    {
+        pool->parallelFor(groups.size() - 1, run);
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (outputs[i].result < 0)
+            return outputs[i].result;
+    }
+    return 0;
+}
+
+/*
+ * Compresses n independent buffers in one call, as chimp_compress_data_ex()
+ * would one by one. Every participant of the pool keeps one
+ * ChimpCompressContext for the whole batch.
+ * ret: 0, or the error of the first failed input; outputs[i].result holds the
+ * compressed size of input i or its error.
+ */
+inline int32_t
+chimp_compress_batch(const ChimpBatchInput *inputs, ChimpBatchOutput *outputs, size_t n,
+                     ChimpThreadPool *pool = nullptr, int policy = CHIMP_POLICY_SMALLEST)
+{
+    std::vector<ChimpCompressContext> contexts(pool != nullptr ? pool->size() : 1);
+
+    return chimp_run_batch(inputs, outputs, n, pool, [&](size_t i, int worker)
+    {
+        return chimp_compress_data_ex(inputs[i].source, inputs[i].source_size,
+                                      outputs[i].dest, outputs[i].dst_size, policy, nullptr, &contexts[worker]);
+    });
+}
+
+/*
+ * Decompresses n independent blocks in one call.
+ * ret: 0, or the error of the first failed input; outputs[i].result holds the
+ * decompressed size of input i or its error.
+ */
+inline int32_t
+chimp_decompress_batch(const ChimpBatchInput *inputs, ChimpBatchOutput *outputs, size_t n,
+                       ChimpThreadPool *pool = nullptr)
+{
+    return chimp_run_batch(inputs, outputs, n, pool, [&](size_t i, int)
+    {
+        return chimp_decompress_data(inputs[i].source, inputs[i].source_size, outputs[i].dest, outputs[i].dst_size);
+    });
+}
@@ -0,0 +1,260 @@
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include "chimp-unit.h"
+
+/**
+ * A bounded single-producer single-consumer ring. push() and pop() wait, first
+ * spinning and then yielding, while the ring is full or empty; the time spent
+ * waiting is added to the caller's counter.
+ */
+template <typename T>
+struct ChimpSpscQueue
+{
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+
+    /** @param capacity rounded up to a power of two. */
+    ChimpSpscQueue(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    bool tryPush(const T &value)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) > mask)
+            return false;
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T &value)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        value = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    void push(const T &value, double &waited)
+    {
+        if (tryPush(value))
+            return;
+        auto start = std::chrono::steady_clock::now();
+        for (int spins = 0; !tryPush(value); spins++)
+        {
+            if (spins > 64)
+                std::this_thread::yield();
+        }
+        waited += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void pop(T &value, double &waited)
+    {
+        if (tryPop(value))
+            return;
+        auto start = std::chrono::steady_clock::now();
+        for (int spins = 0; !tryPop(value); spins++)
+        {
+            if (spins > 64)
+                std::this_thread::yield();
+        }
+        waited += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+struct ChimpStageStats
+{
+    const char *name;
+    uint64_t values = 0;
+    /** Seconds the stage ran, and how many of them it waited on a queue. */
+    double elapsed = 0;
+    double waited = 0;
+
+    /** Values per second while not waiting: what the stage alone could do. */
+    double rate() const
+    {
+        return elapsed > waited ? values / (elapsed - waited) : 0;
+    }
+};
+
+/**
+ * Parses, compresses and writes a series in three stages on their own threads.
+ *
+ * The reader fills batches of blockItems values from the source and deals them
+ * round-robin to the workers; each worker compresses its batches into framed
+ * blocks (see chimp_append_block) and the writer collects them round-robin, so
+ * blocks come out in input order. Every worker has its own lane: an input, an
+ * output and a free queue, all SPSC, and a fixed set of depth batches that go
+ * around it. A stage that runs ahead runs out of batches and waits, which
+ * bounds the memory in flight, and the time each stage waits shows which one
+ * holds the others back.
+ */
+struct ChimpPipeline
+{
+    /** Fills out with up to max values; 0 at the end of the input. */
+    typedef std::function<uint32_t(double *out, uint32_t max)> Source;
+    /** Receives each framed block in order. */
+    typedef std::function<void(const char *block, uint32_t size)> Sink;
+
+    struct Batch
+    {
+        std::vector<double> values;
+        uint32_t n = 0;
+        std::vector<char> block;
+        uint32_t size = 0;
+    };
+
+    struct Lane
+    {
+        ChimpSpscQueue<Batch *> in, out, free;
+        std::vector<Batch> batches;
+        ChimpStageStats stats;
+
+        Lane(size_t depth, uint32_t blockItems) : in(depth), out(depth), free(depth), batches(depth)
+        {
+            double waited = 0;
+            for (auto &b : batches)
+            {
+                b.values.resize(blockItems);
+                b.block.resize(CHIMP_FRAME_SIZE + CHIMP_COMPRESS_BOUND(blockItems * 8));
+                free.push(&b, waited);
+            }
+            stats.name = "compress";
+        }
+    };
+
+    uint32_t blockItems;
+    int nworkers;
+    size_t depth;
+
+    ChimpStageStats reader;
+    /** The workers' stats added up, waits included. */
+    ChimpStageStats workers;
+    ChimpStageStats writer;
+
+    ChimpPipeline(uint32_t preBlockItems = 3600, int preWorkers = 0, size_t preDepth = 4)
+    {
+        blockItems = preBlockItems > 0 ? preBlockItems : 1;
+        nworkers = preWorkers > 0 ? preWorkers : std::thread::hardware_concurrency();
+        if (nworkers < 1)
+            nworkers = 1;
+        depth = preDepth;
+    }
+
+    /**
+     * ret: the number of values written, or a negative ENCODING_* error. A
+     *      block that fails to compress stops the pipeline, and neither it nor
+     *      the blocks after it reach the sink.
+     */
+    int64_t run(Source source, Sink sink)
+    {
+        std::vector<std::unique_ptr<Lane>> lanes;
+        for (int w = 0; w < nworkers; w++)
+            lanes.emplace_back(new Lane(depth, blockItems));
+        std::atomic<int32_t> error(0);
+
+        auto worker = [&](Lane &lane)
+        {
+            ChimpCompressContext ctx(blockItems);
+            auto start = std::chrono::steady_clock::now();
+            Batch *b;
+            while (true)
+            {
+                lane.in.pop(b, lane.stats.waited);
+                if (b->n == 0)
+                    break;
+                // After a failed block the batches in flight only go back round.
+                if (error != 0)
+                {
+                    lane.out.push(b, lane.stats.waited);
+                    continue;
+                }
+                int32_t size = chimp_compress_data_ex((const char *)b->values.data(), b->n * 8,
+                                                      b->block.data() + CHIMP_FRAME_SIZE, b->block.size() - CHIMP_FRAME_SIZE,
+                                                      CHIMP_POLICY_SMALLEST, nullptr, &ctx);
+                if (size < 0)
+                {
+                    error = size;
+                    lane.out.push(b, lane.stats.waited);
+                    continue;
+                }
+                *((uint32_t *)b->block.data()) = size;
+                b->size = CHIMP_FRAME_SIZE + size;
+                lane.stats.values += b->n;
+                lane.out.push(b, lane.stats.waited);
+            }
+            lane.out.push(b, lane.stats.waited);
+            lane.stats.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        std::vector<std::thread> threads;
+        for (auto &lane : lanes)
+            threads.emplace_back(worker, std::ref(*lane));
+
+        threads.emplace_back([&]()
+        {
+            writer = ChimpStageStats();
+            writer.name = "write";
+            auto start = std::chrono::steady_clock::now();
+            Batch *b;
+            for (size_t w = 0;; w = (w + 1) % lanes.size())
+            {
+                lanes[w]->out.pop(b, writer.waited);
+                if (b->n == 0)
+                    break;
+                // Nothing reaches the sink from a failed block on.
+                if (error == 0)
+                {
+                    sink(b->block.data(), b->size);
+                    writer.values += b->n;
+                }
+                lanes[w]->free.push(b, writer.waited);
+            }
+            writer.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        });
+
+        // The reader runs on the calling thread. After the last batch, or once
+        // a block failed, every lane gets an empty one; the writer stops at the first.
+        reader = ChimpStageStats();
+        reader.name = "parse";
+        auto start = std::chrono::steady_clock::now();
+        bool done = false;
+        for (size_t w = 0, ended = 0; ended < lanes.size(); w = (w + 1) % lanes.size())
+        {
+            Batch *b;
+            lanes[w]->free.pop(b, reader.waited);
+            b->n = done || error != 0 ? 0 : source(b->values.data(), blockItems);
+            done = b->n == 0;
+            ended += done;
+            reader.values += b->n;
+            lanes[w]->in.push(b, reader.waited);
+        }
+        reader.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        for (auto &t : threads)
+            t.join();
+        workers = ChimpStageStats();
+        workers.name = "compress";
+        for (auto &lane : lanes)
+        {
+            workers.values += lane->stats.values;
+            workers.elapsed += lane->stats.elapsed;
+            workers.waited += lane->stats.waited;
+        }
+        return error != 0 ? error.load() : (int64_t)writer.values;
+    }
+};
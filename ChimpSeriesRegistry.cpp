@@ -0,0 +1,265 @@
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include "chimp-unit.h"
+
+struct ChimpRegistryStats
+{
+    /** Series holding a slab. */
+    uint64_t series = 0;
+    /** Slabs allocated by the arenas, in use or free. */
+    uint64_t slabs = 0;
+    /** Bytes held by the arenas, the series tables and the encoders of the shards. */
+    uint64_t bytes = 0;
+    uint64_t sealedBlocks = 0;
+    uint64_t sealedValues = 0;
+    uint64_t sealedBytes = 0;
+    /** Blocks that failed to compress, and their values, dropped instead of sunk. */
+    uint64_t failedBlocks = 0;
+    uint64_t failedValues = 0;
+    /** Series sealed and dropped by the idle flusher. */
+    uint64_t evicted = 0;
+};
+
+/**
+ * Compresses many series at once for many ingest threads.
+ *
+ * Series ids are hashed to shards, each with its own lock, so threads writing
+ * different shards never contend. A series only holds a slab of blockItems raw
+ * values, carved out of its shard's arena; the encoders live once per shard
+ * (see ChimpCompressContext) and compress a slab when it fills up. An active
+ * series thus costs its slab plus a table entry, whatever the window, and the
+ * memory of a shard only grows with its number of active series.
+ *
+ * A background thread ticks a coarse clock and seals and evicts the series not
+ * written for idleTicks ticks, returning their slab to the arena. Sealed blocks
+ * are handed to the sink under the shard lock.
+ */
+struct ChimpSeriesRegistry
+{
+    /** Receives each sealed block of a series: its bytes (header included) and size. */
+    typedef std::function<void(uint64_t id, const char *block, uint32_t size)> Sink;
+
+    struct Series
+    {
+        double *values;
+        uint32_t count;
+        /** Clock tick of the last append. */
+        uint32_t touched;
+    };
+
+    struct Shard
+    {
+        std::mutex lock;
+        std::unordered_map<uint64_t, Series> series;
+        /** Arena chunks of slabsPerChunk slabs each. */
+        std::vector<std::unique_ptr<double[]>> chunks;
+        std::vector<double *> freeSlabs;
+        ChimpCompressContext ctx;
+        std::vector<char> out;
+        ChimpRegistryStats stats;
+    };
+
+    Sink sink;
+    uint32_t blockItems;
+    /** Slabs an arena allocates at once. */
+    uint32_t slabsPerChunk = 64;
+    uint32_t idleTicks;
+    std::chrono::milliseconds tick;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    std::atomic<uint32_t> clock{0};
+    std::mutex flusherLock;
+    std::condition_variable flusherWake;
+    bool stopping = false;
+    std::thread flusher;
+
+    /**
+     * @param preIdleTicks ticks of preTick after which a series is sealed and
+     *        evicted; 0 disables the flusher.
+     */
+    ChimpSeriesRegistry(Sink preSink, uint32_t preBlockItems = 1024, size_t preShards = 64,
+                        uint32_t preIdleTicks = 60, std::chrono::milliseconds preTick = std::chrono::milliseconds(1000))
+        : sink(preSink), tick(preTick)
+    {
+        blockItems = preBlockItems > 0 ? preBlockItems : 1;
+        idleTicks = preIdleTicks;
+        for (size_t s = 0; s < preShards; s++)
+        {
+            shards.emplace_back(new Shard());
+            shards.back()->out.resize(CHIMP_COMPRESS_BOUND(blockItems * 8));
+        }
+        if (idleTicks > 0)
+            flusher = std::thread([this]() { runFlusher(); });
+    }
+
+    ChimpSeriesRegistry(const ChimpSeriesRegistry &) = delete;
+    ChimpSeriesRegistry &operator=(const ChimpSeriesRegistry &) = delete;
+
+    ~ChimpSeriesRegistry()
+    {
+        {
+            std::lock_guard<std::mutex> guard(flusherLock);
+            stopping = true;
+        }
+        flusherWake.notify_one();
+        if (flusher.joinable())
+            flusher.join();
+        flush();
+    }
+
+    void append(uint64_t id, double value)
+    {
+        append(id, &value, 1);
+    }
+
+    void append(uint64_t id, const double *values, size_t n)
+    {
+        Shard &shard = shardOf(id);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto it = shard.series.find(id);
+        if (it == shard.series.end())
+            it = shard.series.emplace(id, Series{allocateSlab(shard), 0, 0}).first;
+        Series &s = it->second;
+        s.touched = clock.load(std::memory_order_relaxed);
+        while (n > 0)
+        {
+            uint32_t take = blockItems - s.count < n ? blockItems - s.count : n;
+            memcpy(s.values + s.count, values, take * sizeof(double));
+            s.count += take;
+            values += take;
+            n -= take;
+            if (s.count == blockItems)
+                seal(shard, id, s);
+        }
+    }
+
+    /**
+     * Seals the pending values of every series, keeping the series.
+     */
+    void flush()
+    {
+        for (auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> guard(shard->lock);
+            for (auto &entry : shard->series)
+                seal(*shard, entry.first, entry.second);
+        }
+    }
+
+    /**
+     * Seals and drops the series not written for idleTicks ticks.
+     * ret: the number of series evicted.
+     */
+    size_t evictIdle()
+    {
+        uint32_t now = clock.load(std::memory_order_relaxed);
+        size_t evicted = 0;
+        for (auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> guard(shard->lock);
+            for (auto it = shard->series.begin(); it != shard->series.end();)
+            {
+                if (now - it->second.touched < idleTicks)
+                {
+                    ++it;
+                    continue;
+                }
+                seal(*shard, it->first, it->second);
+                shard->freeSlabs.push_back(it->second.values);
+                it = shard->series.erase(it);
+                shard->stats.evicted++;
+                evicted++;
+            }
+        }
+        return evicted;
+    }
+
+    /**
+     * The bytes an active series holds at most: its slab and its table entry.
+     */
+    size_t bytesPerSeries() const
+    {
+        return blockItems * sizeof(double) + sizeof(std::pair<const uint64_t, Series>) + 2 * sizeof(void *);
+    }
+
+    ChimpRegistryStats stats()
+    {
+        ChimpRegistryStats total;
+        for (auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> guard(shard->lock);
+            total.series += shard->series.size();
+            total.slabs += (uint64_t)shard->chunks.size() * slabsPerChunk;
+            total.bytes += (uint64_t)shard->chunks.size() * slabsPerChunk * blockItems * sizeof(double) +
+                           shard->series.bucket_count() * sizeof(void *) +
+                           shard->series.size() * (bytesPerSeries() - blockItems * sizeof(double)) +
+                           shard->out.size() + shard->ctx.memoryUsage();
+            total.sealedBlocks += shard->stats.sealedBlocks;
+            total.sealedValues += shard->stats.sealedValues;
+            total.sealedBytes += shard->stats.sealedBytes;
+            total.failedBlocks += shard->stats.failedBlocks;
+            total.failedValues += shard->stats.failedValues;
+            total.evicted += shard->stats.evicted;
+        }
+        return total;
+    }
+
+private:
+    Shard &shardOf(uint64_t id)
+    {
+        // Fibonacci hashing spreads sequential ids over the shards.
+        return *shards[((id * 0x9e3779b97f4a7c15ULL) >> 32) % shards.size()];
+    }
+
+    double *allocateSlab(Shard &shard)
+    {
+        if (shard.freeSlabs.empty())
+        {
+            shard.chunks.emplace_back(new double[(size_t)slabsPerChunk * blockItems]);
+            for (uint32_t i = slabsPerChunk; i-- > 0;)
+                shard.freeSlabs.push_back(shard.chunks.back().get() + (size_t)i * blockItems);
+        }
+        double *slab = shard.freeSlabs.back();
+        shard.freeSlabs.pop_back();
+        return slab;
+    }
+
+    void seal(Shard &shard, uint64_t id, Series &s)
+    {
+        if (s.count == 0)
+            return;
+        int32_t size = chimp_compress_data_ex((const char *)s.values, s.count * 8, shard.out.data(), shard.out.size(),
+                                              CHIMP_POLICY_SMALLEST, nullptr, &shard.ctx);
+        if (size < 0)
+        {
+            shard.stats.failedBlocks++;
+            shard.stats.failedValues += s.count;
+            s.count = 0;
+            return;
+        }
+        sink(id, shard.out.data(), size);
+        shard.stats.sealedBlocks++;
+        shard.stats.sealedValues += s.count;
+        shard.stats.sealedBytes += size;
+        s.count = 0;
+    }
+
+    void runFlusher()
+    {
+        std::unique_lock<std::mutex> guard(flusherLock);
+        while (!flusherWake.wait_for(guard, tick, [this]() { return stopping; }))
+        {
+            clock.fetch_add(1, std::memory_order_relaxed);
+            guard.unlock();
+            evictIdle();
+            guard.lock();
+        }
+    }
+};
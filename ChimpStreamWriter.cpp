@@ -0,0 +1,157 @@
+#include <vector>
+#include <functional>
+#include "chimp-unit.h"
+
+/**
+ * Compresses a series that arrives a value at a time into sealed blocks.
+ *
+ * Values are buffered until the block holds maxItems of them or, with a byte
+ * budget, until it would compress to about maxBytes; the block is then
+ * compressed and handed to the sink, which may copy it out or push it on a
+ * queue. The block passed to the sink is only valid during the call.
+ *
+ * The value buffer, the output buffer and the encoders are allocated once and
+ * reused for every block, so steady-state appends do not allocate.
+ */
+struct ChimpStreamWriter
+{
+    /** Receives each sealed block: its bytes (header included) and size. */
+    typedef std::function<void(const char *block, uint32_t size)> Sink;
+
+    Sink sink;
+    uint32_t maxItems;
+    /** Largest compressed block, header included; 0 for no byte budget. */
+    uint32_t maxBytes;
+    int policy;
+    /** Whether blocks continue the window of the previous one. */
+    bool continued;
+
+    std::vector<double> values;
+    uint32_t nvalues = 0;
+    std::vector<char> out;
+    ChimpCompressContext ctx;
+    ChimpWindowState state;
+
+    /**
+     * Tracks the compressed size of the pending values for the byte budget,
+     * with the default window of 128 values.
+     */
+    std::unique_ptr<ChimpN> meter;
+
+    /** Blocks and values sealed so far. */
+    uint64_t nblocks = 0;
+    uint64_t sealedValues = 0;
+    uint64_t sealedBytes = 0;
+
+    /**
+     * @param preMaxItems values per block, raised to 1 if 0.
+     * @param preMaxBytes if not 0, raised to CHIMP_COMPRESS_BOUND(8), the size
+     *        of a block of a single value, if smaller.
+     */
+    ChimpStreamWriter(Sink preSink, uint32_t preMaxItems = 3600, uint32_t preMaxBytes = 0,
+                      int prePolicy = CHIMP_POLICY_SMALLEST, bool preContinued = false)
+        : sink(preSink), maxItems(preMaxItems > 0 ? preMaxItems : 1), values(maxItems),
+          out(CHIMP_COMPRESS_BOUND(maxItems * 8)), ctx(maxItems)
+    {
+        maxBytes = preMaxBytes != 0 && preMaxBytes < CHIMP_COMPRESS_BOUND(8) ? CHIMP_COMPRESS_BOUND(8) : preMaxBytes;
+        policy = prePolicy;
+        continued = preContinued;
+        if (maxBytes != 0)
+            meter.reset(new ChimpN(1 << CHIMP_WINDOWS[2].windowLog2, maxItems, CHIMP_WINDOWS[2].threshold, true));
+    }
+
+    ChimpStreamWriter(const ChimpStreamWriter &) = delete;
+    ChimpStreamWriter &operator=(const ChimpStreamWriter &) = delete;
+
+    ~ChimpStreamWriter()
+    {
+        flush();
+    }
+
+    void append(double value)
+    {
+        values[nvalues++] = value;
+        if (nvalues == maxItems)
+        {
+            seal();
+            return;
+        }
+        if (meter)
+        {
+            meter->addValue(value);
+            // The size so far, plus room for the terminator and the header.
+            if ((uint32_t)meter->getSize() / 8 + 16 + CHIMP_HEADER_SIZE >= maxBytes)
+                seal();
+        }
+    }
+
+    void append(const double *batch, size_t n)
+    {
+        // Without a byte budget whole runs of values are copied at once.
+        while (n > 0 && !meter)
+        {
+            uint32_t take = maxItems - nvalues < n ? maxItems - nvalues : n;
+            memcpy(values.data() + nvalues, batch, take * sizeof(double));
+            nvalues += take;
+            batch += take;
+            n -= take;
+            if (nvalues == maxItems)
+                seal();
+        }
+        for (size_t i = 0; i < n; i++)
+            append(batch[i]);
+    }
+
+    /**
+     * Seals the pending values, if any, into a short block.
+     */
+    void flush()
+    {
+        while (nvalues > 0 && seal())
+            ;
+    }
+
+private:
+    /**
+     * Compresses and hands out the pending values. Should the block still
+     * exceed the byte budget, only the share of it that fits is sealed and the
+     * rest stays pending.
+     * ret: false if the block could not be compressed, which leaves it pending.
+     */
+    bool seal()
+    {
+        uint32_t n = nvalues;
+        ChimpWindowState saved;
+        if (continued && maxBytes != 0)
+            saved = state;
+        int32_t size;
+        while (true)
+        {
+            size = chimp_compress_data_ex((const char *)values.data(), n * 8, out.data(), out.size(),
+                                          policy, continued ? &state : nullptr, &ctx);
+            if (size < 0 || maxBytes == 0 || (uint32_t)size <= maxBytes || n == 1)
+                break;
+            n = (uint64_t)n * maxBytes / size;
+            n = n > 0 ? n : 1;
+            if (continued)
+                state = saved;
+        }
+        if (size < 0)
+            return false;
+
+        sink(out.data(), size);
+        nblocks++;
+        sealedValues += n;
+        sealedBytes += size;
+
+        memmove(values.data(), values.data() + n, (nvalues - n) * sizeof(double));
+        nvalues -= n;
+        if (meter)
+        {
+            meter->reset();
+            for (uint32_t i = 0; i < nvalues; i++)
+                meter->addValue(values[i]);
+        }
+        return true;
+    }
+};
@@ -0,0 +1,157 @@
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+/**
+ * A fixed set of threads running parallel loops with work stealing.
+ *
+ * parallelFor() cuts the index space into one contiguous range per participant,
+ * the calling thread included. Each participant takes indices from the front
+ * of its own range and, once it is empty, steals from the back of the others,
+ * so uneven items (blocks of different codecs or sizes) even out without a
+ * shared counter being hit for every index.
+ *
+ * Loops run one at a time; a loop body must not start another loop on the same
+ * pool.
+ */
+struct ChimpThreadPool
+{
+    /** Runs item index on participant worker, 0 being the calling thread. */
+    typedef std::function<void(size_t index, int worker)> Body;
+
+    struct alignas(64) Range
+    {
+        std::mutex lock;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    std::vector<std::thread> threads;
+    std::unique_ptr<Range[]> ranges;
+
+    std::mutex loopLock;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    const Body *body = nullptr;
+    uint64_t generation = 0;
+    int running = 0;
+    bool stopping = false;
+
+    /**
+     * @param preThreads participants including the calling thread; 0 for one
+     *        per hardware thread.
+     */
+    ChimpThreadPool(int preThreads = 0)
+    {
+        int n = preThreads > 0 ? preThreads : std::thread::hardware_concurrency();
+        if (n < 1)
+            n = 1;
+        ranges.reset(new Range[n]);
+        for (int w = 1; w < n; w++)
+            threads.emplace_back([this, w]() { run(w); });
+    }
+
+    ChimpThreadPool(const ChimpThreadPool &) = delete;
+    ChimpThreadPool &operator=(const ChimpThreadPool &) = delete;
+
+    ~ChimpThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &t : threads)
+            t.join();
+    }
+
+    /** Participants in a loop, the calling thread included. */
+    int size() const
+    {
+        return threads.size() + 1;
+    }
+
+    void parallelFor(size_t n, const Body &fn)
+    {
+        std::lock_guard<std::mutex> loop(loopLock);
+        size_t participants = size();
+        for (size_t w = 0; w < participants; w++)
+        {
+            std::lock_guard<std::mutex> guard(ranges[w].lock);
+            ranges[w].begin = n * w / participants;
+            ranges[w].end = n * (w + 1) / participants;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            body = &fn;
+            generation++;
+            running = threads.size();
+        }
+        wake.notify_all();
+
+        work(0);
+
+        std::unique_lock<std::mutex> guard(lock);
+        finished.wait(guard, [this]() { return running == 0; });
+        body = nullptr;
+    }
+
+private:
+    void run(int self)
+    {
+        uint64_t seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&]() { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            work(self);
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (--running == 0)
+                    finished.notify_one();
+            }
+        }
+    }
+
+    void work(int self)
+    {
+        size_t index;
+        while (take(self, index) || steal(self, index))
+            (*body)(index, self);
+    }
+
+    bool take(int self, size_t &index)
+    {
+        Range &r = ranges[self];
+        std::lock_guard<std::mutex> guard(r.lock);
+        if (r.begin == r.end)
+            return false;
+        index = r.begin++;
+        return true;
+    }
+
+    bool steal(int self, size_t &index)
+    {
+        for (int k = 1; k < size(); k++)
+        {
+            Range &r = ranges[(self + k) % size()];
+            std::lock_guard<std::mutex> guard(r.lock);
+            if (r.begin != r.end)
+            {
+                index = --r.end;
+                return true;
+            }
+        }
+        return false;
+    }
+};
@@ -0,0 +1,119 @@
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include "chimp-unit.h"
+#include "CSVReader-mmap.cpp"
+
+/**
+ * Loads one column of a CSV file on several threads and compresses it into a
+ * block stream.
+ *
+ * The mapped file is cut into byte ranges whose starts are moved to the next
+ * line boundary. Workers take ranges in turn, parse them a block at a time and
+ * compress each block into the range's own stream; the streams are then
+ * concatenated in file order. Ranges are compressed independently, so the last
+ * block of every range may be short. Empty lines are skipped.
+ */
+struct ParallelCSVLoader
+{
+    /** Values per compressed block. */
+    uint32_t blockItems;
+
+    int nthreads;
+
+    /** Smallest range handed to a worker, so that short blocks stay rare. */
+    size_t minRange = 16 << 20;
+
+    /** Values loaded by the last call to load(). */
+    uint64_t nvalues = 0;
+
+    /** 0, or the ENCODING_* error of a block that stopped the last call to load(). */
+    int32_t error = 0;
+
+    ParallelCSVLoader(uint32_t preBlockItems = 3600, int preThreads = 0)
+    {
+        blockItems = preBlockItems > 0 ? preBlockItems : 1;
+        nthreads = preThreads > 0 ? preThreads : std::thread::hardware_concurrency();
+        if (nthreads < 1)
+            nthreads = 1;
+    }
+
+    /*
+     * ret: the block stream, empty if a block failed to compress (see error).
+     */
+    std::vector<char> load(const std::string &filename, size_t col = 2)
+    {
+        CSVReader reader(filename, ",", col);
+        const char *data = reader.mapping();
+        size_t length = reader.mappingSize();
+
+        // A few ranges per thread even out uneven lines and slow threads.
+        size_t nranges = length / minRange;
+        if (nranges > (size_t)nthreads * 4)
+            nranges = nthreads * 4;
+        if (nranges < 1)
+            nranges = 1;
+
+        std::vector<const char *> starts(nranges + 1);
+        starts[0] = data;
+        starts[nranges] = data + length;
+        for (size_t r = 1; r < nranges; r++)
+        {
+            const char *p = data + length / nranges * r;
+            if (p[-1] != '\n')
+            {
+                p = (const char *)memchr(p, '\n', data + length - p);
+                p = p == nullptr ? data + length : p + 1;
+            }
+            starts[r] = p > starts[r - 1] ? p : starts[r - 1];
+        }
+
+        std::vector<std::vector<char>> streams(nranges);
+        std::atomic<size_t> next(0);
+        std::atomic<uint64_t> total(0);
+        std::atomic<int32_t> failed(0);
+
+        auto worker = [&]()
+        {
+            std::vector<double> block(blockItems);
+            size_t r;
+            while (failed == 0 && (r = next++) < nranges)
+            {
+                const char *p = starts[r];
+                size_t n;
+                while (failed == 0 && (n = reader.parseRange(p, starts[r + 1], block.data(), blockItems)) != 0)
+                {
+                    int32_t size = chimp_append_block(streams[r], (const char *)block.data(), n);
+                    if (size < 0)
+                        failed = size;
+                    else
+                        total += n;
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        int nworkers = (size_t)nthreads < nranges ? nthreads : nranges;
+        for (int t = 1; t < nworkers; t++)
+            threads.emplace_back(worker);
+        worker();
+        for (auto &t : threads)
+            t.join();
+
+        error = failed;
+        nvalues = error != 0 ? 0 : total.load();
+        if (error != 0)
+            return std::vector<char>();
+
+        size_t size = 0;
+        for (auto &s : streams)
+            size += s.size();
+        std::vector<char> out;
+        out.reserve(size);
+        for (auto &s : streams)
+            out.insert(out.end(), s.begin(), s.end());
+        return out;
+    }
+};
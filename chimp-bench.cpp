@@ -0,0 +1,297 @@
+#include "ChimpBench.cpp"
+#include "chimp-perf.h"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+using namespace std;
+
+struct Dataset
+{
+    string name;
+    vector<double> values;
+};
+
+/**
+ * A way of encoding a dataset: the adaptive block API, or ChimpN with one of
+ * the CHIMP_WINDOWS candidates.
+ */
+struct Config
+{
+    string name;
+    string codec;
+    /** Index in CHIMP_WINDOWS, or -1 for the block API. */
+    int window;
+};
+
+/**
+ * Encodes and decodes a dataset a block at a time into buffers allocated
+ * once, so that the timed loops only run the codec.
+ */
+struct Codec
+{
+    const Config &config;
+    const vector<double> &values;
+    uint32_t blockItems;
+    size_t nblocks;
+    vector<char> compressed;
+    /** Offset and size of every block in compressed. */
+    vector<size_t> offsets;
+    vector<uint32_t> sizes;
+    vector<double> decoded;
+    ChimpCompressContext ctx;
+    unique_ptr<ChimpN> encoder;
+    bool failed = false;
+
+    Codec(const Config &c, const vector<double> &v, uint32_t preBlockItems)
+        : config(c), values(v), blockItems(preBlockItems), decoded(v.size())
+    {
+        nblocks = (values.size() + blockItems - 1) / blockItems;
+        sizes.resize(nblocks);
+        for (size_t b = 0; b < nblocks; b++)
+            offsets.push_back(b * (size_t)CHIMP_COMPRESS_BOUND(blockItems * 9 + 32));
+        compressed.resize(nblocks * (size_t)CHIMP_COMPRESS_BOUND(blockItems * 9 + 32));
+        if (config.window >= 0)
+            encoder.reset(new ChimpN(1 << CHIMP_WINDOWS[config.window].windowLog2, blockItems,
+                                     CHIMP_WINDOWS[config.window].threshold, true));
+    }
+
+    uint32_t items(size_t b) const
+    {
+        return b + 1 < nblocks ? blockItems : values.size() - b * blockItems;
+    }
+
+    void encode()
+    {
+        for (size_t b = 0; b < nblocks; b++)
+        {
+            const char *source = (const char *)(values.data() + b * blockItems);
+            char *dest = compressed.data() + offsets[b];
+            if (config.window < 0)
+            {
+                int32_t size = chimp_compress_data_ex(source, items(b) * 8, dest, CHIMP_COMPRESS_BOUND(blockItems * 8),
+                                                      CHIMP_POLICY_SMALLEST, nullptr, &ctx);
+                failed |= size < 0;
+                sizes[b] = size;
+                continue;
+            }
+            encoder->reset();
+            for (uint32_t i = 0; i < items(b); i++)
+                encoder->addValue(*((uint64_t *)source + i));
+            encoder->close();
+            sizes[b] = encoder->obs.pos;
+            memcpy(dest, encoder->getOut(), encoder->obs.pos);
+        }
+    }
+
+    void decode()
+    {
+        for (size_t b = 0; b < nblocks; b++)
+        {
+            const char *source = compressed.data() + offsets[b];
+            char *dest = (char *)(decoded.data() + b * blockItems);
+            if (config.window < 0)
+                failed |= chimp_decompress_data(source, sizes[b], dest, items(b) * 8) < 0;
+            else
+                failed |= chimp_decode_chimpn(source, sizes[b], items(b), CHIMP_WINDOWS[config.window].windowLog2, true,
+                                              nullptr, dest) != items(b);
+        }
+    }
+
+#ifdef CHIMP_STATS
+    /** Encodes once more and sums up what the records of that pass are made of. */
+    ChimpEncoderStats encoderStats()
+    {
+        for (size_t k = 0; k < CHIMP_NWINDOWS; k++) {
+            if (ctx.encoders[k])
+                ctx.encoders[k]->stats.clear();
+        }
+        if (encoder)
+            encoder->stats.clear();
+        encode();
+
+        ChimpEncoderStats total;
+        for (size_t k = 0; k < CHIMP_NWINDOWS; k++) {
+            if (ctx.encoders[k])
+                total.merge(ctx.encoders[k]->stats);
+        }
+        if (encoder)
+            total.merge(encoder->stats);
+        return total;
+    }
+#endif
+
+    /** Heap bytes held by the encoders. */
+    size_t encoderMemory() const
+    {
+        return encoder ? encoder->memoryUsage() : ctx.memoryUsage();
+    }
+
+    /** Decodes once more and returns the most heap the decoders held at once. */
+    int64_t decoderPeakMemory()
+    {
+        ChimpMemoryTracker::resetPeaks();
+        int64_t before = ChimpMemoryTracker::totals(CHIMP_MEMORY_DECODER).current;
+        decode();
+        return ChimpMemoryTracker::totals(CHIMP_MEMORY_DECODER).peak - before;
+    }
+
+    uint64_t compressedBytes() const
+    {
+        uint64_t total = 0;
+        for (uint32_t s : sizes)
+            total += s;
+        return total;
+    }
+};
+
+/*
+ * Runs f once more under the hardware counters and adds name_<event>_per_value
+ * and name_ipc, null for the events the machine does not count.
+ */
+template <typename F>
+static void countEvents(ChimpBenchRow &row, const string &name, ChimpPerfCounters &counters, F f, size_t nvalues)
+{
+    counters.start();
+    f();
+    ChimpPerfSample s = counters.stop();
+    for (int e = 0; e < CHIMP_PERF_NEVENTS; e++)
+        row.add(name + "_" + CHIMP_PERF_NAMES[e] + "_per_value", s.has(e) ? s.counts[e] / nvalues : NAN);
+    row.add(name + "_ipc", s.ipc() >= 0 ? s.ipc() : NAN);
+}
+
+static void usage()
+{
+    cout << "usage: chimp-bench [--reps N] [--warmup N] [--block N] [--format text|json|csv] [--output file]\n"
+            "                   [--config auto|windows|all] [--values N] [--seed N] [--no-counters] [dataset...]\n"
+            "  dataset: a generator, file.csv[:column] or a file of raw little-endian doubles\n"
+            "  generators (all of them by default, --values each):";
+    for (size_t k = 0; k < CHIMP_NDATASETS; k++)
+        cout << " " << CHIMP_DATASETS[k].name;
+    cout << endl;
+}
+
+/*
+ * Times encoding and decoding of every dataset with every configuration and
+ * reports per value costs, throughputs and bits per value.
+ */
+int main(int argc, char *argv[])
+{
+    int reps = 10, warmup = 2;
+    uint32_t blockItems = 3600;
+    size_t nvalues = 1 << 20;
+    uint64_t seed = 1;
+    bool useCounters = true;
+    string format = "text", output, which = "all";
+    vector<string> specs;
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg == "--reps" && i + 1 < argc)
+            reps = atoi(argv[++i]);
+        else if (arg == "--warmup" && i + 1 < argc)
+            warmup = atoi(argv[++i]);
+        else if (arg == "--block" && i + 1 < argc)
+            blockItems = atoi(argv[++i]);
+        else if (arg == "--format" && i + 1 < argc)
+            format = argv[++i];
+        else if (arg == "--output" && i + 1 < argc)
+            output = argv[++i];
+        else if (arg == "--config" && i + 1 < argc)
+            which = argv[++i];
+        else if (arg == "--values" && i + 1 < argc)
+            nvalues = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--no-counters")
+            useCounters = false;
+        else if (arg[0] == '-') {
+            usage();
+            return -1;
+        } else
+            specs.push_back(arg);
+    }
+    if (specs.empty()) {
+        for (size_t k = 0; k < CHIMP_NDATASETS; k++)
+            specs.push_back(CHIMP_DATASETS[k].name);
+    }
+    if (reps < 1 || blockItems < 1) {
+        usage();
+        return -1;
+    }
+
+    vector<Config> configs;
+    if (which != "windows")
+        configs.push_back({"auto", "auto", -1});
+    if (which != "auto") {
+        for (size_t k = 0; k < CHIMP_NWINDOWS; k++)
+            configs.push_back({"chimpn-w" + to_string(1 << CHIMP_WINDOWS[k].windowLog2) + "-t" +
+                                   to_string(CHIMP_WINDOWS[k].threshold),
+                               "chimpn", (int)k});
+    }
+
+    ChimpMemoryTracker::enable(true);
+    ChimpPerfCounters counters;
+    if (useCounters && !counters.available())
+        cerr << "hardware counters unavailable, reporting timings only" << endl;
+
+    ChimpBenchReport report;
+    for (const string &spec : specs) {
+        Dataset d;
+        d.name = spec;
+        if (!chimp_bench_load(spec, d.values, nvalues, seed) || d.values.empty()) {
+            cerr << "skipping " << spec << ": no values" << endl;
+            continue;
+        }
+        double rawBytes = d.values.size() * 8.0;
+        for (const Config &config : configs) {
+            Codec codec(config, d.values, blockItems);
+            vector<double> enc = chimp_bench_time([&]() { codec.encode(); }, warmup, reps);
+            vector<double> dec = chimp_bench_time([&]() { codec.decode(); }, warmup, reps);
+            bool verified = !codec.failed && memcmp(codec.decoded.data(), d.values.data(), rawBytes) == 0;
+            double compressedBytes = codec.compressedBytes();
+
+            for (double &s : enc)
+                s = s * 1e9 / d.values.size();
+            for (double &s : dec)
+                s = s * 1e9 / d.values.size();
+            ChimpBenchStats encns = ChimpBenchStats::of(enc), decns = ChimpBenchStats::of(dec);
+            double enctime = encns.median * d.values.size() / 1e9, dectime = decns.median * d.values.size() / 1e9;
+
+            ChimpBenchRow row;
+            row.add("dataset", d.name)
+                .add("seed", chimp_find_dataset(d.name.c_str()) != nullptr ? (double)seed : NAN)
+                .add("config", config.name)
+                .add("codec", config.codec)
+                .add("window", config.window < 0 ? NAN : (double)(1 << CHIMP_WINDOWS[config.window].windowLog2))
+                .add("values", (double)d.values.size())
+                .add("block", (double)blockItems)
+                .add("reps", (double)reps)
+                .add("bits_per_value", compressedBytes * 8 / d.values.size())
+                .add("ratio", rawBytes / compressedBytes)
+                .add("encode_ns_per_value", encns)
+                .add("encode_mb_s_in", rawBytes / enctime / 1e6)
+                .add("encode_mb_s_out", compressedBytes / enctime / 1e6)
+                .add("decode_ns_per_value", decns)
+                .add("decode_mb_s_in", compressedBytes / dectime / 1e6)
+                .add("decode_mb_s_out", rawBytes / dectime / 1e6)
+                .add("verified", verified ? "yes" : "no")
+                .add("encoder_heap_bytes", (double)codec.encoderMemory())
+                .add("decoder_heap_peak_bytes", (double)codec.decoderPeakMemory());
+            if (useCounters) {
+                countEvents(row, "encode", counters, [&]() { codec.encode(); }, d.values.size());
+                countEvents(row, "decode", counters, [&]() { codec.decode(); }, d.values.size());
+            }
+#ifdef CHIMP_STATS
+            codec.encoderStats().visit([&](const char *name, double value) { row.add(string("stats_") + name, value); });
+#endif
+            report.rows.push_back(row);
+        }
+    }
+
+    if (output.empty()) {
+        report.write(cout, format);
+    } else {
+        ofstream ofs(output);
+        report.write(ofs, format);
+    }
+    return 0;
+}
@@ -0,0 +1,257 @@
+// The chimp workloads take their field widths from ChimpN's record traces.
+#define CHIMP_STATS
+#include "ChimpBench.cpp"
+#include "chimp-perf.h"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <functional>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+using namespace std;
+
+/**
+ * One call to the bitstream: len bits of value, through writeInt()/readInt()
+ * or writeLong()/readLong().
+ */
+struct Field
+{
+    uint64_t value;
+    uint8_t len;
+    bool isLong;
+};
+
+struct Workload
+{
+    string name;
+    vector<Field> fields;
+    uint64_t bits = 0;
+};
+
+static void addField(Workload &w, uint64_t value, int len, bool isLong)
+{
+    uint64_t mask = len == 64 ? ~0ULL : (1ULL << len) - 1;
+    w.fields.push_back({value & mask, (uint8_t)len, isLong});
+    w.bits += len;
+}
+
+/* Fields of uniformly random widths in [lo, hi], the widths from longFrom up written as longs. */
+static Workload uniform(const string &name, size_t calls, int lo, int hi, int longFrom, uint64_t seed)
+{
+    Workload w;
+    ChimpRandom rng(seed);
+    w.name = name;
+    for (size_t i = 0; i < calls; i++) {
+        int len = lo + rng.next() % (hi - lo + 1);
+        addField(w, rng.next(), len, len >= longFrom);
+    }
+    return w;
+}
+
+/*
+ * The fields ChimpN writes for a dataset, in order: record headers through
+ * writeInt() and first values and XOR bits through writeLong().
+ */
+static Workload recorded(const string &dataset, size_t calls, uint64_t seed)
+{
+    Workload w;
+    vector<double> values;
+    chimp_bench_load(dataset, values, calls, seed);
+    w.name = "chimp-" + dataset;
+
+    ChimpN enc(128, values.size(), 13, false);
+    for (size_t i = 0; i < values.size() && w.fields.size() < calls; i++) {
+        enc.addValue(values[i]);
+        const ChimpRecordTrace &t = enc.trace;
+        switch (t.record) {
+        case -1:
+            addField(w, t.xorvalue, 64, true);
+            break;
+        case CHIMP_RECORD_REPEAT:
+            addField(w, i, enc.flagZeroSize, false);
+            break;
+        case CHIMP_RECORD_WINDOW:
+            addField(w, i, enc.flagOneSize, false);
+            addField(w, t.xorvalue >> t.trailingZeros, t.bits - enc.flagOneSize, true);
+            break;
+        default:
+        {
+            int header = t.record == CHIMP_RECORD_SAME_LEADING ? 2 : 5;
+            addField(w, t.record == CHIMP_RECORD_SAME_LEADING ? 2 : 24, header, false);
+            addField(w, t.xorvalue, t.bits - header, true);
+            break;
+        }
+        }
+    }
+    return w;
+}
+
+static inline uint64_t cycleCounter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Cycles one run of f takes: core cycles from the hardware counters if they
+ * can be read, reference cycles from the time stamp counter otherwise.
+ * ret: the cycles, or a negative value without either; source names the one used.
+ */
+template <typename F>
+static double countCycles(ChimpPerfCounters &counters, F f, string &source)
+{
+    counters.start();
+    uint64_t tsc = cycleCounter();
+    f();
+    tsc = cycleCounter() - tsc;
+    ChimpPerfSample s = counters.stop();
+    if (s.has(CHIMP_PERF_CYCLES)) {
+        source = "core";
+        return s.counts[CHIMP_PERF_CYCLES];
+    }
+    source = tsc > 0 ? "tsc" : "none";
+    return tsc > 0 ? (double)tsc : -1;
+}
+
+static void usage()
+{
+    cout << "usage: chimp-bitbench [--calls N] [--reps N] [--warmup N] [--seed N] [--format text|json|csv]\n"
+            "                      [--output file] [dataset...]\n"
+            "  times OutputBitStream::writeInt/writeLong, InputBitStream::readInt/readLong and refill\n"
+            "  on 9-bit fields, 40-64 bit fields, mixed 1-64 bit fields and the fields ChimpN writes\n"
+            "  for each dataset (sine-noise and prices by default)" << endl;
+}
+
+/*
+ * Micro-benchmarks the bitstream primitives on field width distributions of
+ * Chimp streams, outside of the codec, reporting ns per call and bits per cycle.
+ */
+int main(int argc, char *argv[])
+{
+    size_t calls = 1 << 20;
+    int reps = 10, warmup = 2;
+    uint64_t seed = 1;
+    string format = "text", output;
+    vector<string> datasets;
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg == "--calls" && i + 1 < argc)
+            calls = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--reps" && i + 1 < argc)
+            reps = atoi(argv[++i]);
+        else if (arg == "--warmup" && i + 1 < argc)
+            warmup = atoi(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--format" && i + 1 < argc)
+            format = argv[++i];
+        else if (arg == "--output" && i + 1 < argc)
+            output = argv[++i];
+        else if (arg[0] == '-') {
+            usage();
+            return -1;
+        } else
+            datasets.push_back(arg);
+    }
+    if (calls < 1 || reps < 1) {
+        usage();
+        return -1;
+    }
+    if (datasets.empty())
+        datasets = {"sine-noise", "prices"};
+
+    vector<Workload> workloads;
+    workloads.push_back(uniform("int-9", calls, 9, 9, 65, seed));
+    workloads.push_back(uniform("long-40-64", calls, 40, 64, 0, seed));
+    workloads.push_back(uniform("mixed-1-64", calls, 1, 64, 32, seed));
+    for (const string &d : datasets)
+        workloads.push_back(recorded(d, calls, seed));
+
+    ChimpPerfCounters counters;
+    ChimpBenchReport report;
+    for (const Workload &w : workloads) {
+        if (w.fields.empty()) {
+            cerr << "skipping " << w.name << ": no values" << endl;
+            continue;
+        }
+        // readLong() and refill() may look two bytes past the last field.
+        vector<uint8_t> buffer(w.bits / 8 + 16);
+        vector<uint64_t> back(w.fields.size());
+        uint64_t refills = w.bits / 16;
+
+        auto write = [&]()
+        {
+            OutputBitStream out(buffer.data());
+            out.writtenBits = 0;
+            for (const Field &f : w.fields) {
+                if (f.isLong)
+                    out.writeLong(f.value, f.len);
+                else
+                    out.writeInt((int)f.value, f.len);
+            }
+            out.flush();
+        };
+        auto read = [&]()
+        {
+            InputBitStream in(buffer.data(), buffer.size() / 8);
+            for (size_t i = 0; i < w.fields.size(); i++)
+                back[i] = w.fields[i].isLong ? in.readLong(w.fields[i].len) : (uint32_t)in.readInt(w.fields[i].len);
+        };
+        auto refill = [&]()
+        {
+            InputBitStream in(buffer.data(), buffer.size() / 8);
+            uint32_t sum = 0;
+            for (uint64_t i = 0; i < refills; i++) {
+                in.refill();
+                sum += in.current;
+                in.fill -= 16;
+            }
+            back[0] = sum;
+        };
+
+        struct Op
+        {
+            const char *name;
+            function<void()> run;
+            uint64_t calls;
+        } ops[] = {{"write", write, w.fields.size()}, {"read", read, w.fields.size()}, {"refill", refill, refills}};
+
+        for (const Op &op : ops) {
+            ChimpBenchStats ns = ChimpBenchStats::of(chimp_bench_time(op.run, warmup, reps));
+            string source;
+            double cycles = countCycles(counters, op.run, source);
+            bool verified = true;
+            if (string(op.name) == "read") {
+                for (size_t i = 0; i < w.fields.size() && verified; i++)
+                    verified = back[i] == w.fields[i].value;
+            }
+            uint64_t bits = string(op.name) == "refill" ? refills * 16 : w.bits;
+            for (double *s : {&ns.min, &ns.median, &ns.mean, &ns.stddev})
+                *s = *s * 1e9 / op.calls;
+
+            ChimpBenchRow row;
+            row.add("workload", w.name)
+                .add("op", op.name)
+                .add("calls", (double)op.calls)
+                .add("bits_per_call", (double)bits / op.calls)
+                .add("ns_per_call", ns)
+                .add("bits_per_ns", bits / (ns.median * op.calls))
+                .add("bits_per_cycle", cycles > 0 ? bits / cycles : NAN)
+                .add("cycles", source)
+                .add("verified", verified ? "yes" : "no");
+            report.rows.push_back(row);
+        }
+    }
+
+    if (output.empty()) {
+        report.write(cout, format);
+    } else {
+        ofstream ofs(output);
+        report.write(ofs, format);
+    }
+    return 0;
+}
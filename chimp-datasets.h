@@ -0,0 +1,204 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cinttypes>
+
+/*
+ * Seeded generators of typical series shapes, so that benchmarks run without
+ * external data. They only use integer arithmetic, basic double operations and
+ * their own random number generator, so a seed gives the same values with any
+ * compiler or standard library.
+ */
+
+/**
+ * splitmix64: small, fast and fully specified.
+ */
+struct ChimpRandom
+{
+    uint64_t state;
+
+    ChimpRandom(uint64_t seed) : state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    /** Uniform in [0, 1). */
+    double uniform()
+    {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    /** Roughly normal with mean 0 and deviation 1: a sum of 12 uniforms. */
+    double gaussian()
+    {
+        double sum = 0;
+        for (int i = 0; i < 12; i++)
+            sum += uniform();
+        return sum - 6;
+    }
+};
+
+/* Rounds to a fixed number of decimals, the way values printed by sensors or
+ * exchanges parse back. */
+inline double
+chimp_round_decimals(double value, int decimals)
+{
+    static const double scales[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    return std::round(value * scales[decimals]) / scales[decimals];
+}
+
+inline void
+chimp_gen_random_walk(std::vector<double> &out, size_t n, uint64_t seed)
+{
+    ChimpRandom rng(seed);
+    double value = 100;
+    out.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        value += rng.gaussian();
+        out[i] = value;
+    }
+}
+
+inline void
+chimp_gen_sine_noise(std::vector<double> &out, size_t n, uint64_t seed)
+{
+    // A daily cycle of one value a minute, rotated step by step rather than
+    // through std::sin, whose last bit may differ between libms.
+    const double c = 0.9999904807207345, s = 0.004363309284746571;
+    ChimpRandom rng(seed);
+    double x = 1, y = 0;
+    out.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] = chimp_round_decimals(20 + 8 * y + 0.5 * rng.gaussian(), 2);
+        double t = x * c - y * s;
+        y = x * s + y * c;
+        x = t;
+    }
+}
+
+inline void
+chimp_gen_steps(std::vector<double> &out, size_t n, uint64_t seed)
+{
+    ChimpRandom rng(seed);
+    double level = 50;
+    out.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        if (rng.next() % 500 == 0)
+            level = chimp_round_decimals(rng.uniform() * 100, 1);
+        out[i] = level;
+    }
+}
+
+inline void
+chimp_gen_prices(std::vector<double> &out, size_t n, uint64_t seed)
+{
+    ChimpRandom rng(seed);
+    int64_t cents = 10000;
+    out.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        // Most ticks leave the price alone; the others move it a few cents.
+        if (rng.next() % 4 == 0)
+            cents += (int64_t)(rng.gaussian() * 5);
+        if (cents < 1)
+            cents = 1;
+        out[i] = cents / 100.0;
+    }
+}
+
+inline void
+chimp_gen_counter(std::vector<double> &out, size_t n, uint64_t seed)
+{
+    ChimpRandom rng(seed);
+    double value = 0;
+    out.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        value += rng.next() % 100;
+        out[i] = value;
+    }
+}
+
+inline void
+chimp_gen_spikes(std::vector<double> &out, size_t n, uint64_t seed)
+{
+    ChimpRandom rng(seed);
+    out.resize(n);
+    for (size_t i = 0; i < n; i++)
+        out[i] = rng.next() % 1000 == 0 ? chimp_round_decimals(rng.uniform() * 1000, 3) : 0;
+}
+
+inline void
+chimp_gen_constant_runs(std::vector<double> &out, size_t n, uint64_t seed)
+{
+    ChimpRandom rng(seed);
+    double value = 1;
+    size_t left = 0;
+    out.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        if (left-- == 0)
+        {
+            value = chimp_round_decimals(rng.uniform() * 10, 1);
+            left = 1 + rng.next() % 200;
+        }
+        out[i] = value;
+    }
+}
+
+inline void
+chimp_gen_random_bits(std::vector<double> &out, size_t n, uint64_t seed)
+{
+    ChimpRandom rng(seed);
+    out.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t bits = rng.next();
+        // Keep clear of the NaN patterns, which ChimpN cannot hold.
+        if ((bits & 0x7ff0000000000000ULL) == 0x7ff0000000000000ULL)
+            bits ^= 0x4000000000000000ULL;
+        memcpy(&out[i], &bits, sizeof(bits));
+    }
+}
+
+struct ChimpDataset
+{
+    const char *name;
+    void (*generate)(std::vector<double> &out, size_t n, uint64_t seed);
+};
+
+static const ChimpDataset CHIMP_DATASETS[] = {
+    {"random-walk", chimp_gen_random_walk},
+    {"sine-noise", chimp_gen_sine_noise},
+    {"steps", chimp_gen_steps},
+    {"prices", chimp_gen_prices},
+    {"counter", chimp_gen_counter},
+    {"spikes", chimp_gen_spikes},
+    {"constant-runs", chimp_gen_constant_runs},
+    {"random-bits", chimp_gen_random_bits},
+};
+
+#define CHIMP_NDATASETS (sizeof(CHIMP_DATASETS) / sizeof(CHIMP_DATASETS[0]))
+
+/*
+ * ret: the generator called name, or nullptr.
+ */
+inline const ChimpDataset *
+chimp_find_dataset(const char *name)
+{
+    for (size_t k = 0; k < CHIMP_NDATASETS; k++)
+    {
+        if (strcmp(CHIMP_DATASETS[k].name, name) == 0)
+            return &CHIMP_DATASETS[k];
+    }
+    return nullptr;
+}
@@ -0,0 +1,319 @@
+// The trace of every record comes from ChimpN's statistics.
+#define CHIMP_STATS
+#include "ChimpParallel.cpp"
+#include "ChimpBench.cpp"
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <cstdlib>
+#include <cinttypes>
+using namespace std;
+
+/**
+ * One value of a ChimpN block as the encoder wrote it.
+ */
+struct Record
+{
+    uint32_t block;
+    uint32_t pos;
+    uint64_t value;
+    ChimpRecordTrace trace;
+    /** The record's bits, plus those of the run it opened. */
+    int bits;
+    /** Whether this is the terminator closing the block. */
+    bool end;
+};
+
+static const char *caseName(const Record &r)
+{
+    static const char *const cases[CHIMP_NRECORDS] = {"repeat", "window", "same-lead", "new-lead"};
+    if (r.end)
+        return "end";
+    if (r.trace.record < 0)
+        return "first";
+    if (r.trace.inRun)
+        return "run";
+    return cases[r.trace.record];
+}
+
+/**
+ * What the trace adds up to over all blocks.
+ */
+struct Summary
+{
+    uint64_t values = 0;
+    uint64_t bits = 0;
+    uint64_t cases[CHIMP_NRECORDS + 2] = {};
+    uint64_t caseBits[CHIMP_NRECORDS + 2] = {};
+    /** Values and bits by position in the block: 0, 1, 2-3, 4-7 and so on. */
+    uint64_t posValues[33] = {};
+    uint64_t posBits[33] = {};
+    /** Blocks not encoded with ChimpN, by codec. */
+    uint64_t otherBlocks[3] = {};
+    uint64_t otherBytes[3] = {};
+    uint32_t mismatches = 0;
+    vector<Record> top;
+};
+
+/*
+ * Decodes one block, then encodes its values again with the window, threshold
+ * and flags of its header, recording how every value was written. The encoder
+ * being deterministic, the records are those of the block, which the payload
+ * comparison confirms.
+ */
+static bool explainBlock(const char *block, uint32_t size, uint32_t blockIndex, ChimpWindowState &state,
+                         vector<Record> &records)
+{
+    records.clear();
+    uint32_t nitems = *((uint32_t *)block);
+    uint8_t codec = block[4], windowLog2 = block[5], threshold = block[6], flags = block[7];
+    ChimpWindowState before = state;
+    vector<double> values(nitems);
+    if (chimp_decompress_data_ex(block, size, (char *)values.data(), nitems * 8, &state) < 0) {
+        cerr << "block " << blockIndex << ": corrupted" << endl;
+        return false;
+    }
+    if (codec != CHIMP_CODEC_CHIMPN)
+        return true;
+
+    ChimpN enc(1 << windowLog2, nitems, threshold, flags & CHIMP_FLAG_RUNS);
+    if (flags & CHIMP_FLAG_CONTINUATION)
+        enc.restore(before);
+    size_t runStart = 0;
+    for (uint32_t i = 0; i <= nitems; i++) {
+        bool end = i == nitems;
+        uint64_t value = end ? enc.NAN_LONG : *((uint64_t *)&values[i]);
+        if (end)
+            enc.close();
+        else
+            enc.addValue(value);
+
+        const ChimpRecordTrace &t = enc.trace;
+        if (t.runBits > 0)
+            records[runStart].bits += t.runBits;
+        if (t.record == CHIMP_RECORD_REPEAT && !t.inRun && (flags & CHIMP_FLAG_RUNS))
+            runStart = records.size();
+        records.push_back({blockIndex, i, value, t, t.bits, end});
+    }
+
+    uint32_t payload = size - CHIMP_HEADER_SIZE;
+    return (uint32_t)enc.obs.pos == payload && memcmp(enc.getOut(), block + CHIMP_HEADER_SIZE, payload) == 0;
+}
+
+static void printRecords(const vector<Record> &records)
+{
+    for (const Record &r : records) {
+        double value;
+        memcpy(&value, &r.value, 8);
+        printf("%6u %6u %24.17g %-9s %5d %016" PRIx64 " %3d %3d %3d\n", r.block, r.pos, value, caseName(r),
+               r.trace.distance, r.trace.xorvalue, r.trace.leadingZeros, r.trace.trailingZeros, r.bits);
+    }
+}
+
+static void summarize(const vector<Record> &records, Summary &s, size_t ntop)
+{
+    for (const Record &r : records) {
+        int c = r.end ? CHIMP_NRECORDS + 1 : r.trace.record < 0 ? CHIMP_NRECORDS : r.trace.record;
+        s.cases[c]++;
+        s.caseBits[c] += r.bits;
+        s.bits += r.bits;
+        if (r.end)
+            continue;
+        s.values++;
+        int bucket = r.pos == 0 ? 0 : 64 - __builtin_clzll(r.pos);
+        s.posValues[bucket]++;
+        s.posBits[bucket] += r.bits;
+        s.top.push_back(r);
+    }
+    // Keep only the most expensive values seen so far.
+    auto costlier = [](const Record &a, const Record &b) { return a.bits > b.bits; };
+    if (s.top.size() > ntop) {
+        partial_sort(s.top.begin(), s.top.begin() + ntop, s.top.end(), costlier);
+        s.top.resize(ntop);
+    }
+}
+
+static void printSummary(Summary &s)
+{
+    static const char *const names[CHIMP_NRECORDS + 2] = {"repeat", "window", "same-lead", "new-lead", "first",
+                                                          "end"};
+    static const char *const codecs[3] = {"raw", "chimpn", "constant"};
+
+    printf("\nChimpN values: %" PRIu64 " bits: %" PRIu64 " bits/value: %.3f\n", s.values, s.bits,
+           s.values ? (double)s.bits / s.values : 0.0);
+    for (int c = 0; c < 3; c++) {
+        if (s.otherBlocks[c] > 0)
+            printf("%s blocks: %" PRIu64 " bytes: %" PRIu64 "\n", codecs[c], s.otherBlocks[c], s.otherBytes[c]);
+    }
+    if (s.mismatches > 0)
+        printf("blocks whose encoding could not be reproduced: %u\n", s.mismatches);
+
+    printf("\n%-10s %10s %8s %12s %10s\n", "case", "records", "share", "bits", "bits/rec");
+    for (int c = 0; c < CHIMP_NRECORDS + 2; c++) {
+        if (s.cases[c] == 0)
+            continue;
+        printf("%-10s %10" PRIu64 " %7.2f%% %12" PRIu64 " %10.2f\n", names[c], s.cases[c],
+               100.0 * s.cases[c] / (s.values + s.cases[CHIMP_NRECORDS + 1]), s.caseBits[c],
+               (double)s.caseBits[c] / s.cases[c]);
+    }
+
+    printf("\n%-15s %10s %10s\n", "block position", "values", "bits/value");
+    for (int b = 0; b < 33; b++) {
+        if (s.posValues[b] == 0)
+            continue;
+        uint64_t lo = b == 0 ? 0 : 1ULL << (b - 1), hi = b == 0 ? 0 : (1ULL << b) - 1;
+        char range[32];
+        snprintf(range, sizeof(range), lo == hi ? "%" PRIu64 : "%" PRIu64 "-%" PRIu64, lo, hi);
+        printf("%-15s %10" PRIu64 " %10.2f\n", range, s.posValues[b], (double)s.posBits[b] / s.posValues[b]);
+    }
+
+    sort(s.top.begin(), s.top.end(), [](const Record &a, const Record &b) { return a.bits > b.bits; });
+    printf("\nmost expensive values:\n");
+    printf("%6s %6s %24s %-9s %5s %16s %3s %3s %3s\n", "block", "pos", "value", "case", "ref", "xor", "lz", "tz",
+           "bits");
+    printRecords(s.top);
+}
+
+static bool readFile(const string &path, vector<char> &data)
+{
+    ifstream in(path, ios::binary);
+    if (!in)
+        return false;
+    data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    return true;
+}
+
+/*
+ * Encodes a block with a given window and threshold instead of the ones the
+ * block API would pick.
+ */
+static void encodeForced(const double *values, uint32_t nitems, int windowLog2, int threshold, vector<char> &block)
+{
+    ChimpN enc(1 << windowLog2, nitems, threshold, true);
+    for (uint32_t i = 0; i < nitems; i++)
+        enc.addValue(values[i]);
+    enc.close();
+    block.resize(CHIMP_HEADER_SIZE + enc.obs.pos);
+    *((uint32_t *)block.data()) = nitems;
+    block[4] = CHIMP_CODEC_CHIMPN;
+    block[5] = windowLog2;
+    block[6] = threshold;
+    block[7] = CHIMP_FLAG_RUNS;
+    memcpy(block.data() + CHIMP_HEADER_SIZE, enc.getOut(), enc.obs.pos);
+}
+
+static void usage()
+{
+    cout << "usage: chimp-explain [--block N] [--window LOG2 --threshold T] [--values N] [--seed N] [--top N]\n"
+            "                     [--summary] dataset\n"
+            "       chimp-explain [--top N] [--summary] --compressed file.stream\n"
+            "  dataset: a generator, file.csv[:column] or a file of raw little-endian doubles,\n"
+            "           cut into blocks and encoded as the block API would, or with the given window\n"
+            "  file.stream: a block stream, as written by chimp-unit, chimp-load or chimp-pipeline" << endl;
+}
+
+/*
+ * Prints, for every value of every ChimpN block, the reference it was XORed
+ * with, the XOR, its leading and trailing zeros, the record case and the bits
+ * it took, then where the bits went.
+ */
+int main(int argc, char *argv[])
+{
+    uint32_t blockItems = 3600;
+    int windowLog2 = -1, threshold = -1;
+    size_t nvalues = 1 << 16, ntop = 20;
+    uint64_t seed = 1;
+    bool compressed = false, summaryOnly = false;
+    string spec;
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg == "--block" && i + 1 < argc)
+            blockItems = atoi(argv[++i]);
+        else if (arg == "--window" && i + 1 < argc)
+            windowLog2 = atoi(argv[++i]);
+        else if (arg == "--threshold" && i + 1 < argc)
+            threshold = atoi(argv[++i]);
+        else if (arg == "--values" && i + 1 < argc)
+            nvalues = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--top" && i + 1 < argc)
+            ntop = atoi(argv[++i]);
+        else if (arg == "--compressed")
+            compressed = true;
+        else if (arg == "--summary")
+            summaryOnly = true;
+        else if (arg[0] == '-' || !spec.empty()) {
+            usage();
+            return -1;
+        } else
+            spec = arg;
+    }
+    if (spec.empty() || blockItems < 1 || windowLog2 > 16 || (windowLog2 >= 0) != (threshold >= 0)) {
+        usage();
+        return -1;
+    }
+
+    // Either way, the trace runs over a block stream.
+    vector<char> stream;
+    if (compressed) {
+        if (!readFile(spec, stream)) {
+            cerr << "cannot read " << spec << endl;
+            return -1;
+        }
+    } else {
+        vector<double> values;
+        if (!chimp_bench_load(spec, values, nvalues, seed)) {
+            cerr << "cannot read " << spec << endl;
+            return -1;
+        }
+        vector<char> block;
+        for (size_t first = 0; first < values.size(); first += blockItems) {
+            uint32_t nitems = min((size_t)blockItems, values.size() - first);
+            if (windowLog2 < 0) {
+                chimp_append_block(stream, (const char *)(values.data() + first), nitems);
+                continue;
+            }
+            encodeForced(values.data() + first, nitems, windowLog2, threshold, block);
+            uint32_t size = block.size();
+            stream.insert(stream.end(), (const char *)&size, (const char *)&size + CHIMP_FRAME_SIZE);
+            stream.insert(stream.end(), block.begin(), block.end());
+        }
+    }
+
+    vector<ChimpFrame> frames;
+    if (chimp_scan_stream(stream.data(), stream.size(), frames) < 0) {
+        cerr << "corrupted block stream" << endl;
+        return -1;
+    }
+
+    if (!summaryOnly)
+        printf("%6s %6s %24s %-9s %5s %16s %3s %3s %3s\n", "block", "pos", "value", "case", "ref", "xor", "lz",
+               "tz", "bits");
+    Summary summary;
+    ChimpWindowState state;
+    vector<Record> records;
+    for (size_t b = 0; b < frames.size(); b++) {
+        const ChimpFrame &f = frames[b];
+        bool same = explainBlock(f.block, f.size, b, state, records);
+        uint8_t codec = f.block[4];
+        if (codec != CHIMP_CODEC_CHIMPN && codec < 3) {
+            summary.otherBlocks[codec]++;
+            summary.otherBytes[codec] += f.size;
+            if (!summaryOnly)
+                printf("%6zu %s block of %u values, %u bytes\n", b, codec == CHIMP_CODEC_RAW ? "raw" : "constant",
+                       f.nitems, f.size);
+            continue;
+        }
+        if (!same) {
+            summary.mismatches++;
+            cerr << "block " << b << ": encoding not reproduced, its trace may be off" << endl;
+        }
+        if (!summaryOnly)
+            printRecords(records);
+        summarize(records, summary, ntop);
+    }
+    printSummary(summary);
+    return 0;
+}
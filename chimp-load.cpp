@@ -0,0 +1,80 @@
+#include "ParallelCSVLoader.cpp"
+#include "ChimpParallel.cpp"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+using namespace std::chrono;
+using namespace std;
+
+/*
+ * chimp-load file.csv [column] [threads] [output]
+ *
+ * Loads a CSV column in parallel into a block stream, checks it against a
+ * sequential read, times decoding it sequentially and in parallel, and
+ * optionally writes it out.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        cout << "usage: chimp-load file.csv [column] [threads] [output]" << endl;
+        return -1;
+    }
+    string filename(argv[1]);
+    size_t column = argc > 2 ? atoi(argv[2]) : 2;
+    int nthreads = argc > 3 ? atoi(argv[3]) : 0;
+
+    ParallelCSVLoader loader(3600, nthreads);
+    auto starttime = steady_clock::now();
+    vector<char> stream = loader.load(filename, column);
+    duration<double> diff = steady_clock::now() - starttime;
+    if (loader.error != 0) {
+        cerr << "compression failed: " << loader.error << endl;
+        return 1;
+    }
+
+    CSVReader reader(filename, ",", column);
+    cout << "threads: " << loader.nthreads << " values: " << loader.nvalues
+         << " time: " << diff.count() << "s "
+         << reader.mappingSize() / diff.count() / 1e6 << " MB/s" << endl;
+    cout << "compressed_size: " << stream.size()
+         << " compressed_rate: " << stream.size() * 1.0 / (loader.nvalues * 8) << endl;
+
+    // Walk the stream a block at a time against a sequential read of the file.
+    const char *p = reader.mapping();
+    const char *block = stream.data();
+    vector<double> decoded, expected;
+    bool same = true;
+    while (same && block < stream.data() + stream.size()) {
+        uint32_t blocksize = *((uint32_t *)block);
+        uint32_t nitems = *((uint32_t *)(block + CHIMP_FRAME_SIZE));
+        decoded.resize(nitems);
+        expected.resize(nitems);
+        same = chimp_decompress_data(block + CHIMP_FRAME_SIZE, blocksize, (char *)decoded.data(), nitems * 8) == (int32_t)nitems * 8 &&
+               reader.parseRange(p, reader.mapping() + reader.mappingSize(), expected.data(), nitems) == nitems &&
+               memcmp(decoded.data(), expected.data(), nitems * 8) == 0;
+        block += CHIMP_FRAME_SIZE + blocksize;
+    }
+    double extra;
+    same = same && reader.parseRange(p, reader.mapping() + reader.mappingSize(), &extra, 1) == 0;
+    cout << "matches sequential read: " << (same ? "yes" : "no") << endl;
+
+    vector<double> sequential, parallel(loader.nvalues);
+    starttime = steady_clock::now();
+    chimp_decompress_stream(stream.data(), stream.size(), sequential);
+    duration<double> seqdiff = steady_clock::now() - starttime;
+    ChimpThreadPool pool(loader.nthreads);
+    starttime = steady_clock::now();
+    int64_t decoded_values = chimp_decompress_stream_parallel(stream.data(), stream.size(), parallel.data(), parallel.size(), &pool);
+    duration<double> pardiff = steady_clock::now() - starttime;
+    same = same && decoded_values == (int64_t)loader.nvalues && parallel == sequential;
+    cout << "decompress: sequential " << loader.nvalues / seqdiff.count() / 1e6 << " Mvalues/s"
+         << " parallel " << loader.nvalues / pardiff.count() / 1e6 << " Mvalues/s"
+         << " matches: " << (decoded_values == (int64_t)loader.nvalues && parallel == sequential ? "yes" : "no") << endl;
+
+    if (argc > 4) {
+        ofstream ofs(argv[4], ios::binary);
+        ofs.write(stream.data(), stream.size());
+    }
+    return same ? 0 : 1;
+}
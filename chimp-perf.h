@@ -0,0 +1,175 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/*
+ * Hardware counters of the calling thread through perf_event_open, for
+ * telling why a codec change is faster and not only that it is. Every counter
+ * is opened on its own, so a PMU missing one event (often the cache events in
+ * virtual machines) still gives the others, and one without any, or a kernel
+ * that refuses them, leaves the benchmarks with their timings only.
+ */
+
+enum ChimpPerfEvent
+{
+    CHIMP_PERF_CYCLES,
+    CHIMP_PERF_INSTRUCTIONS,
+    CHIMP_PERF_BRANCH_MISSES,
+    CHIMP_PERF_L1D_MISSES,
+    CHIMP_PERF_LLC_MISSES,
+    CHIMP_PERF_NEVENTS
+};
+
+static const char *const CHIMP_PERF_NAMES[CHIMP_PERF_NEVENTS] = {
+    "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses"};
+
+/**
+ * The counts of one measured region; a counter that could not be opened reads
+ * as a negative value.
+ */
+struct ChimpPerfSample
+{
+    double counts[CHIMP_PERF_NEVENTS];
+
+    bool has(int event) const
+    {
+        return counts[event] >= 0;
+    }
+
+    /** Instructions per cycle, or a negative value. */
+    double ipc() const
+    {
+        if (!has(CHIMP_PERF_CYCLES) || !has(CHIMP_PERF_INSTRUCTIONS) || counts[CHIMP_PERF_CYCLES] == 0)
+            return -1;
+        return counts[CHIMP_PERF_INSTRUCTIONS] / counts[CHIMP_PERF_CYCLES];
+    }
+};
+
+/**
+ * Counts user space events of the calling thread between start() and stop().
+ * Counts are scaled by the time each counter was scheduled, in case the kernel
+ * had to multiplex them.
+ */
+struct ChimpPerfCounters
+{
+    int fds[CHIMP_PERF_NEVENTS];
+
+    ChimpPerfCounters()
+    {
+        for (int e = 0; e < CHIMP_PERF_NEVENTS; e++)
+            fds[e] = open(e);
+    }
+
+    ChimpPerfCounters(const ChimpPerfCounters &) = delete;
+    ChimpPerfCounters &operator=(const ChimpPerfCounters &) = delete;
+
+    ~ChimpPerfCounters()
+    {
+#ifdef __linux__
+        for (int e = 0; e < CHIMP_PERF_NEVENTS; e++)
+        {
+            if (fds[e] >= 0)
+                close(fds[e]);
+        }
+#endif
+    }
+
+    /** Whether any counter could be opened. */
+    bool available() const
+    {
+        for (int e = 0; e < CHIMP_PERF_NEVENTS; e++)
+        {
+            if (fds[e] >= 0)
+                return true;
+        }
+        return false;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        for (int e = 0; e < CHIMP_PERF_NEVENTS; e++)
+        {
+            if (fds[e] >= 0)
+            {
+                ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    ChimpPerfSample stop()
+    {
+        ChimpPerfSample s;
+        for (int e = 0; e < CHIMP_PERF_NEVENTS; e++)
+            s.counts[e] = -1;
+#ifdef __linux__
+        for (int e = 0; e < CHIMP_PERF_NEVENTS; e++)
+        {
+            if (fds[e] >= 0)
+                ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        }
+        for (int e = 0; e < CHIMP_PERF_NEVENTS; e++)
+        {
+            // value, time enabled, time running
+            uint64_t r[3];
+            if (fds[e] < 0 || read(fds[e], r, sizeof(r)) != sizeof(r))
+                continue;
+            if (r[2] == 0)
+                s.counts[e] = r[0] == 0 ? 0 : -1;
+            else
+                s.counts[e] = (double)r[0] * r[1] / r[2];
+        }
+#endif
+        return s;
+    }
+
+private:
+    static int open(int event)
+    {
+#ifdef __linux__
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        switch (event)
+        {
+        case CHIMP_PERF_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case CHIMP_PERF_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case CHIMP_PERF_BRANCH_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case CHIMP_PERF_L1D_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case CHIMP_PERF_LLC_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        }
+        return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+        return -1;
+#endif
+    }
+};
@@ -0,0 +1,83 @@
+#include "ChimpPipeline.cpp"
+#include "CSVReader-mmap.cpp"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+using namespace std;
+
+static void report(const ChimpStageStats &s, int threads)
+{
+    cout << s.name << ": values " << s.values << " busy " << (s.elapsed - s.waited) / threads << "s"
+         << " waiting " << (s.elapsed > 0 ? s.waited * 100 / s.elapsed : 0) << "%"
+         << " rate " << s.rate() * threads / 1e6 << " Mvalues/s" << endl;
+}
+
+/*
+ * chimp-pipeline file.csv output [column] [workers] [blockItems]
+ *
+ * Converts a CSV column into a block stream through ChimpPipeline, reports
+ * what every stage could sustain on its own, and checks the output against a
+ * sequential read.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        cout << "usage: chimp-pipeline file.csv output [column] [workers] [blockItems]" << endl;
+        return -1;
+    }
+    size_t column = argc > 3 ? atoi(argv[3]) : 2;
+    int nworkers = argc > 4 ? atoi(argv[4]) : 0;
+    uint32_t blockItems = argc > 5 ? atoi(argv[5]) : 3600;
+
+    CSVReader reader(argv[1], ",", column);
+    const char *p = reader.mapping();
+    const char *end = p + reader.mappingSize();
+    ofstream ofs(argv[2], ios::binary);
+
+    ChimpPipeline pipeline(blockItems, nworkers);
+    auto starttime = chrono::steady_clock::now();
+    int64_t n = pipeline.run(
+        [&](double *out, uint32_t max) { return (uint32_t)reader.parseRange(p, end, out, max); },
+        [&](const char *block, uint32_t size) { ofs.write(block, size); });
+    ofs.close();
+    chrono::duration<double> diff = chrono::steady_clock::now() - starttime;
+    if (n < 0 || ofs.fail()) {
+        cout << "conversion failed" << endl;
+        return -1;
+    }
+
+    cout << "workers: " << pipeline.nworkers << " values: " << n << " time: " << diff.count() << "s "
+         << reader.mappingSize() / diff.count() / 1e6 << " MB/s" << endl;
+    report(pipeline.reader, 1);
+    report(pipeline.workers, pipeline.nworkers);
+    report(pipeline.writer, 1);
+
+    // Walk the output a block at a time against a sequential read of the file.
+    ifstream ifs(argv[2], ios::binary);
+    p = reader.mapping();
+    vector<char> block;
+    vector<double> decoded, expected;
+    uint32_t blocksize;
+    bool same = true;
+    while (same && ifs.read((char *)&blocksize, CHIMP_FRAME_SIZE)) {
+        if (blocksize < CHIMP_HEADER_SIZE) {
+            same = false;
+            break;
+        }
+        block.resize(blocksize);
+        if (!ifs.read(block.data(), blocksize)) {
+            same = false;
+            break;
+        }
+        uint32_t nitems = *((uint32_t *)block.data());
+        decoded.resize(nitems);
+        expected.resize(nitems);
+        same = chimp_decompress_data(block.data(), blocksize, (char *)decoded.data(), nitems * 8) == (int32_t)nitems * 8 &&
+               reader.parseRange(p, end, expected.data(), nitems) == nitems &&
+               memcmp(decoded.data(), expected.data(), nitems * 8) == 0;
+    }
+    double extra;
+    same = same && reader.parseRange(p, end, &extra, 1) == 0;
+    cout << "matches sequential read: " << (same ? "yes" : "no") << endl;
+    return same ? 0 : 1;
+}
@@ -0,0 +1,296 @@
+#include "ChimpBench.cpp"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <map>
+#include <dirent.h>
+#include <sys/stat.h>
+using namespace std;
+
+/*
+ * Two-sided Student t quantiles for 95% and 99% confidence, by degrees of
+ * freedom from 1 to 30; past 30 the normal quantile is close enough.
+ */
+static const double T95[30] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                               2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                               2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+static const double T99[30] = {63.657, 9.925, 5.841, 4.604, 4.032, 3.707, 3.499, 3.355, 3.250, 3.169,
+                               3.106, 3.055, 3.012, 2.977, 2.947, 2.921, 2.898, 2.878, 2.861, 2.845,
+                               2.831, 2.819, 2.807, 2.797, 2.787, 2.779, 2.771, 2.763, 2.756, 2.750};
+
+static double tQuantile(double df, int confidence)
+{
+    int d = (int)df;
+    if (d < 1)
+        d = 1;
+    if (d <= 30)
+        return confidence == 99 ? T99[d - 1] : T95[d - 1];
+    return confidence == 99 ? 2.576 : 1.960;
+}
+
+/* A result is identified by dataset and configuration, block size and number of values included. */
+static string key(const ChimpBenchRow &row)
+{
+    return row.get("dataset") + " " + row.get("config") + " block=" + row.get("block") +
+           " values=" + row.get("values");
+}
+
+static string storePath(const string &dir, const string &commit)
+{
+    return dir + "/" + commit + ".json";
+}
+
+static bool load(const string &path, ChimpBenchReport &report)
+{
+    ifstream in(path);
+    return in && report.read(in);
+}
+
+static bool save(const string &path, const ChimpBenchReport &report)
+{
+    string temp = path + ".tmp";
+    {
+        ofstream out(temp);
+        report.write(out, "json");
+        if (!out)
+            return false;
+    }
+    return rename(temp.c_str(), path.c_str()) == 0;
+}
+
+/*
+ * Adds the rows of a chimp-bench JSON result to the run of commit, replacing
+ * those of a previous result with the same key.
+ */
+static int store(const string &dir, const string &commit, const vector<string> &files)
+{
+    for (char c : commit) {
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_' && c != '.') {
+            cerr << "commit ids are made of letters, digits, '-', '_' and '.'" << endl;
+            return -1;
+        }
+    }
+    mkdir(dir.c_str(), 0755);
+
+    ChimpBenchReport run, added;
+    load(storePath(dir, commit), run);
+    for (const string &file : files) {
+        if (!load(file, added)) {
+            cerr << file << ": not a chimp-bench JSON result" << endl;
+            return -1;
+        }
+    }
+    map<string, size_t> positions;
+    for (size_t r = 0; r < run.rows.size(); r++)
+        positions[key(run.rows[r])] = r;
+    for (const ChimpBenchRow &row : added.rows) {
+        auto it = positions.find(key(row));
+        if (it != positions.end()) {
+            run.rows[it->second] = row;
+        } else {
+            positions[key(row)] = run.rows.size();
+            run.rows.push_back(row);
+        }
+    }
+    if (!save(storePath(dir, commit), run)) {
+        cerr << "cannot write " << storePath(dir, commit) << endl;
+        return -1;
+    }
+    cout << commit << ": " << added.rows.size() << " results stored, " << run.rows.size() << " in total" << endl;
+    return 0;
+}
+
+static int list(const string &dir)
+{
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+        cerr << "cannot open " << dir << endl;
+        return -1;
+    }
+    vector<string> commits;
+    while (struct dirent *e = readdir(d)) {
+        string name(e->d_name);
+        if (name.size() > 5 && name.substr(name.size() - 5) == ".json")
+            commits.push_back(name.substr(0, name.size() - 5));
+    }
+    closedir(d);
+    sort(commits.begin(), commits.end());
+
+    for (const string &commit : commits) {
+        ChimpBenchReport run;
+        load(storePath(dir, commit), run);
+        cout << commit << ": " << run.rows.size() << " results" << endl;
+    }
+    return 0;
+}
+
+/**
+ * One metric of one result in both runs, and how it moved.
+ */
+struct Change
+{
+    double base;
+    double candidate;
+    /** Relative change of the mean and its confidence interval, + being larger. */
+    double change;
+    double low;
+    double high;
+    string verdict;
+};
+
+/*
+ * Compares the mean of a timing between two runs with Welch's t interval on
+ * the difference; a change counts if the whole interval is past threshold on
+ * the same side.
+ */
+static Change compareTiming(const ChimpBenchRow &b, const ChimpBenchRow &c, const string &metric, int confidence,
+                            double threshold)
+{
+    double mb = atof(b.get(metric + "_mean").c_str()), mc = atof(c.get(metric + "_mean").c_str());
+    double sb = atof(b.get(metric + "_stddev").c_str()), sc = atof(c.get(metric + "_stddev").c_str());
+    double nb = atof(b.get("reps").c_str()), nc = atof(c.get("reps").c_str());
+
+    Change ch;
+    ch.base = mb;
+    ch.candidate = mc;
+    ch.change = (mc - mb) / mb;
+    if (nb < 2 || nc < 2) {
+        ch.low = ch.high = ch.change;
+        ch.verdict = "unknown";
+        return ch;
+    }
+    double vb = sb * sb / nb, vc = sc * sc / nc;
+    double se = sqrt(vb + vc);
+    double df = se == 0 ? nb + nc - 2 : (vb + vc) * (vb + vc) / (vb * vb / (nb - 1) + vc * vc / (nc - 1));
+    double margin = tQuantile(df, confidence) * se;
+    ch.low = (mc - mb - margin) / mb;
+    ch.high = (mc - mb + margin) / mb;
+    if (ch.low > threshold)
+        ch.verdict = "slower";
+    else if (ch.high < -threshold)
+        ch.verdict = "faster";
+    else
+        ch.verdict = "same";
+    return ch;
+}
+
+/* Compressed sizes are deterministic: any change counts. */
+static Change compareSize(const ChimpBenchRow &b, const ChimpBenchRow &c)
+{
+    Change ch;
+    ch.base = atof(b.get("bits_per_value").c_str());
+    ch.candidate = atof(c.get("bits_per_value").c_str());
+    ch.change = ch.low = ch.high = ch.base == 0 ? 0 : (ch.candidate - ch.base) / ch.base;
+    ch.verdict = fabs(ch.candidate - ch.base) <= 1e-9 * ch.base ? "same" : ch.candidate > ch.base ? "larger" : "smaller";
+    return ch;
+}
+
+/*
+ * Compares every result present in both runs.
+ * ret: 1 if a timing got significantly slower or a size larger, 0 otherwise.
+ */
+static int compare(const string &dir, const string &base, const string &candidate, int confidence,
+                   double threshold, const string &format)
+{
+    ChimpBenchReport b, c;
+    if (!load(storePath(dir, base), b) || !load(storePath(dir, candidate), c)) {
+        cerr << "no stored run for " << (b.rows.empty() ? base : candidate) << endl;
+        return -1;
+    }
+    map<string, const ChimpBenchRow *> before;
+    for (const ChimpBenchRow &row : b.rows)
+        before[key(row)] = &row;
+
+    ChimpBenchReport report;
+    int regressions = 0;
+    size_t unmatched = 0;
+    for (const ChimpBenchRow &row : c.rows) {
+        auto it = before.find(key(row));
+        if (it == before.end()) {
+            unmatched++;
+            continue;
+        }
+        const ChimpBenchRow &old = *it->second;
+        for (const char *metric : {"encode_ns_per_value", "decode_ns_per_value", "bits_per_value"}) {
+            Change ch = string(metric) == "bits_per_value" ? compareSize(old, row)
+                                                           : compareTiming(old, row, metric, confidence, threshold);
+            regressions += ch.verdict == "slower" || ch.verdict == "larger";
+            ChimpBenchRow out;
+            out.add("dataset", row.get("dataset"))
+                .add("config", row.get("config"))
+                .add("metric", metric)
+                .add("base", ch.base)
+                .add("candidate", ch.candidate)
+                .add("change_pct", ch.change * 100)
+                .add("ci_low_pct", ch.low * 100)
+                .add("ci_high_pct", ch.high * 100)
+                .add("verdict", ch.verdict);
+            report.rows.push_back(out);
+        }
+    }
+
+    report.write(cout, format);
+    if (format != "json" && format != "csv") {
+        cout << "\n" << base << " -> " << candidate << ": " << report.rows.size() / 3 << " results compared at "
+             << confidence << "% confidence, threshold " << threshold * 100 << "%, " << regressions
+             << " regressions";
+        if (unmatched > 0)
+            cout << ", " << unmatched << " results without a base";
+        cout << endl;
+    }
+    return regressions > 0 ? 1 : 0;
+}
+
+static void usage()
+{
+    cout << "usage: chimp-results store dir commit result.json...\n"
+            "       chimp-results list dir\n"
+            "       chimp-results compare dir base candidate [--confidence 95|99] [--threshold 2]\n"
+            "                     [--format text|json|csv]\n"
+            "  results are chimp-bench --format json outputs, kept in dir/commit.json and keyed by\n"
+            "  dataset, config, block and values; compare exits with 1 when a timing got slower or\n"
+            "  a size larger" << endl;
+}
+
+/*
+ * Keeps chimp-bench results per commit in local files and compares two runs,
+ * flagging slowdowns whose confidence interval is past the threshold and any
+ * change of bits per value.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        usage();
+        return -1;
+    }
+    string command(argv[1]), dir(argv[2]);
+    if (command == "store" && argc >= 5)
+        return store(dir, argv[3], vector<string>(argv + 4, argv + argc));
+    if (command == "list")
+        return list(dir);
+    if (command == "compare" && argc >= 5) {
+        int confidence = 95;
+        double threshold = 2;
+        string format = "text";
+        for (int i = 5; i < argc; i++) {
+            string arg(argv[i]);
+            if (arg == "--confidence" && i + 1 < argc)
+                confidence = atoi(argv[++i]);
+            else if (arg == "--threshold" && i + 1 < argc)
+                threshold = atof(argv[++i]);
+            else if (arg == "--format" && i + 1 < argc)
+                format = argv[++i];
+            else {
+                usage();
+                return -1;
+            }
+        }
+        if (confidence != 95 && confidence != 99) {
+            usage();
+            return -1;
+        }
+        return compare(dir, argv[3], argv[4], confidence, threshold / 100, format);
+    }
+    usage();
+    return -1;
+}
@@ -0,0 +1,244 @@
+#include "ChimpBench.cpp"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <pthread.h>
+#include <sched.h>
+using namespace std;
+
+/**
+ * Lines threads up between the phases of a run, spinning so that they leave
+ * it together.
+ */
+struct SpinBarrier
+{
+    const int parties;
+    atomic<int> waiting{0};
+    atomic<int> generation{0};
+
+    SpinBarrier(int preParties) : parties(preParties) {}
+
+    void wait()
+    {
+        int g = generation.load();
+        if (waiting.fetch_add(1) + 1 == parties) {
+            waiting = 0;
+            generation++;
+        } else {
+            while (generation.load() == g)
+                this_thread::yield();
+        }
+    }
+};
+
+struct Options
+{
+    string dataset = "prices";
+    size_t values = 1 << 20;
+    uint32_t blockItems = 3600;
+    int windowLog2 = 7;
+    int reps = 3;
+    uint64_t seed = 1;
+    bool pin = false;
+    /** Build a new ChimpN for every block instead of reset() on one per thread. */
+    bool allocate = false;
+};
+
+/**
+ * What one thread did in a run.
+ */
+struct Work
+{
+    vector<double> values;
+    vector<char> compressed;
+    vector<uint32_t> sizes;
+    vector<double> decoded;
+    double encodeSeconds = 0;
+    double decodeSeconds = 0;
+    bool verified = true;
+};
+
+static double now()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * One thread of a run: its own series and encoder, encoding then decoding its
+ * blocks opt.reps times, each phase started together with the other threads.
+ */
+static void runThread(int self, const Options &opt, SpinBarrier &barrier, Work &w)
+{
+    if (opt.pin) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(self % thread::hardware_concurrency(), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    chimp_bench_load(opt.dataset, w.values, opt.values, opt.seed + self);
+    size_t nblocks = (w.values.size() + opt.blockItems - 1) / opt.blockItems;
+    size_t stride = 9 * (size_t)opt.blockItems + 32;
+    int threshold = 6 + opt.windowLog2;
+    w.compressed.resize(nblocks * stride);
+    w.sizes.resize(nblocks);
+    w.decoded.resize(w.values.size());
+    unique_ptr<ChimpN> reused(opt.allocate ? nullptr : new ChimpN(1 << opt.windowLog2, opt.blockItems, threshold, true));
+    auto items = [&](size_t b) { return (uint32_t)min((size_t)opt.blockItems, w.values.size() - b * opt.blockItems); };
+
+    barrier.wait();
+    double start = now();
+    for (int r = 0; r < opt.reps; r++) {
+        for (size_t b = 0; b < nblocks; b++) {
+            unique_ptr<ChimpN> fresh;
+            ChimpN *enc = reused.get();
+            if (opt.allocate) {
+                fresh.reset(new ChimpN(1 << opt.windowLog2, opt.blockItems, threshold, true));
+                enc = fresh.get();
+            } else {
+                enc->reset();
+            }
+            const double *source = w.values.data() + b * opt.blockItems;
+            for (uint32_t i = 0; i < items(b); i++)
+                enc->addValue(source[i]);
+            enc->close();
+            w.sizes[b] = enc->obs.pos;
+            memcpy(w.compressed.data() + b * stride, enc->getOut(), enc->obs.pos);
+        }
+    }
+    w.encodeSeconds = now() - start;
+
+    barrier.wait();
+    start = now();
+    for (int r = 0; r < opt.reps; r++) {
+        for (size_t b = 0; b < nblocks; b++)
+            w.verified &= chimp_decode_chimpn(w.compressed.data() + b * stride, w.sizes[b], items(b), opt.windowLog2, true,
+                                              nullptr, (char *)(w.decoded.data() + b * opt.blockItems)) == items(b);
+    }
+    w.decodeSeconds = now() - start;
+    w.verified &= memcmp(w.decoded.data(), w.values.data(), w.values.size() * 8) == 0;
+}
+
+static void usage()
+{
+    cout << "usage: chimp-scaling [--threads 1,2,4,...] [--pin] [--allocate] [--window LOG2] [--block N]\n"
+            "                     [--values N] [--reps N] [--seed N] [--format text|json|csv] [--output file]\n"
+            "                     [dataset]\n"
+            "  every thread encodes and decodes its own series of --values values (generated with seed\n"
+            "  + thread, or the same file) with its own ChimpN; --allocate builds a ChimpN per block\n"
+            "  instead of resetting one, --pin binds thread i to cpu i" << endl;
+}
+
+/*
+ * Runs independent ChimpN encoders and decoders on 1..N threads, reporting
+ * aggregate throughput and how much of the single thread rate each thread
+ * keeps, so that contention on shared caches and the allocator shows up.
+ */
+int main(int argc, char *argv[])
+{
+    Options opt;
+    vector<int> threads;
+    string format = "text", output;
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg == "--threads" && i + 1 < argc) {
+            for (char *p = argv[++i]; *p; p++) {
+                threads.push_back(strtol(p, &p, 10));
+                if (*p != ',')
+                    break;
+            }
+        } else if (arg == "--pin")
+            opt.pin = true;
+        else if (arg == "--allocate")
+            opt.allocate = true;
+        else if (arg == "--window" && i + 1 < argc)
+            opt.windowLog2 = atoi(argv[++i]);
+        else if (arg == "--block" && i + 1 < argc)
+            opt.blockItems = atoi(argv[++i]);
+        else if (arg == "--values" && i + 1 < argc)
+            opt.values = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--reps" && i + 1 < argc)
+            opt.reps = atoi(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            opt.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--format" && i + 1 < argc)
+            format = argv[++i];
+        else if (arg == "--output" && i + 1 < argc)
+            output = argv[++i];
+        else if (arg[0] == '-') {
+            usage();
+            return -1;
+        } else
+            opt.dataset = arg;
+    }
+    if (threads.empty()) {
+        int cores = max(1u, thread::hardware_concurrency());
+        for (int n = 1; n < cores; n *= 2)
+            threads.push_back(n);
+        threads.push_back(cores);
+    }
+    if (opt.reps < 1 || opt.blockItems < 1 || opt.windowLog2 < 0 || opt.windowLog2 > 14 ||
+        *min_element(threads.begin(), threads.end()) < 1) {
+        usage();
+        return -1;
+    }
+
+    ChimpBenchReport report;
+    double singleEncode = 0, singleDecode = 0;
+    for (int n : threads) {
+        vector<Work> work(n);
+        SpinBarrier barrier(n);
+        vector<thread> pool;
+        for (int t = 0; t < n; t++)
+            pool.emplace_back(runThread, t, cref(opt), ref(barrier), ref(work[t]));
+        for (auto &t : pool)
+            t.join();
+
+        double rawBytes = 0, compressedBytes = 0, encodeSeconds = 0, decodeSeconds = 0;
+        bool verified = true;
+        for (const Work &w : work) {
+            rawBytes += w.values.size() * 8.0 * opt.reps;
+            for (uint32_t s : w.sizes)
+                compressedBytes += s;
+            encodeSeconds = max(encodeSeconds, w.encodeSeconds);
+            decodeSeconds = max(decodeSeconds, w.decodeSeconds);
+            verified &= w.verified;
+        }
+        if (rawBytes == 0) {
+            cerr << "no values in " << opt.dataset << endl;
+            return -1;
+        }
+        double encode = rawBytes / encodeSeconds / 1e6, decode = rawBytes / decodeSeconds / 1e6;
+        // Efficiency is measured against the 1 thread run, or the first one made.
+        if (singleEncode == 0) {
+            singleEncode = encode / n;
+            singleDecode = decode / n;
+        }
+
+        ChimpBenchRow row;
+        row.add("dataset", opt.dataset)
+            .add("threads", (double)n)
+            .add("pinned", opt.pin ? "yes" : "no")
+            .add("encoders", opt.allocate ? "per-block" : "per-thread")
+            .add("window", (double)(1 << opt.windowLog2))
+            .add("values_per_thread", (double)work[0].values.size())
+            .add("bits_per_value", compressedBytes * 8 * opt.reps / (rawBytes / 8))
+            .add("encode_mb_s", encode)
+            .add("encode_mb_s_per_thread", encode / n)
+            .add("encode_efficiency", encode / n / singleEncode)
+            .add("decode_mb_s", decode)
+            .add("decode_mb_s_per_thread", decode / n)
+            .add("decode_efficiency", decode / n / singleDecode)
+            .add("verified", verified ? "yes" : "no");
+        report.rows.push_back(row);
+    }
+
+    if (output.empty()) {
+        report.write(cout, format);
+    } else {
+        ofstream ofs(output);
+        report.write(ofs, format);
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "ChimpBench.cpp"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+using namespace std;
+
+/**
+ * A dataset run through ChimpN with one window and threshold, a block at a
+ * time, into buffers allocated once.
+ */
+struct Point
+{
+    int windowLog2;
+    int threshold;
+    double bitsPerValue;
+    double encodeMBs;
+    double decodeMBs;
+    bool verified;
+    bool pareto = false;
+
+    /** Whether this point is at least as good as o everywhere and better somewhere. */
+    bool dominates(const Point &o) const
+    {
+        return bitsPerValue <= o.bitsPerValue && encodeMBs >= o.encodeMBs && decodeMBs >= o.decodeMBs &&
+               (bitsPerValue < o.bitsPerValue || encodeMBs > o.encodeMBs || decodeMBs > o.decodeMBs);
+    }
+};
+
+static Point measure(const vector<double> &values, uint32_t blockItems, int windowLog2, int threshold, int warmup,
+                     int reps)
+{
+    size_t nblocks = (values.size() + blockItems - 1) / blockItems;
+    size_t stride = 9 * (size_t)blockItems + 32;
+    vector<char> compressed(nblocks * stride);
+    vector<uint32_t> sizes(nblocks);
+    vector<double> decoded(values.size());
+    ChimpN enc(1 << windowLog2, blockItems, threshold, true);
+    auto items = [&](size_t b) { return (uint32_t)min((size_t)blockItems, values.size() - b * blockItems); };
+    bool failed = false;
+
+    auto encode = [&]()
+    {
+        for (size_t b = 0; b < nblocks; b++) {
+            const double *source = values.data() + b * blockItems;
+            enc.reset();
+            for (uint32_t i = 0; i < items(b); i++)
+                enc.addValue(source[i]);
+            enc.close();
+            sizes[b] = enc.obs.pos;
+            memcpy(compressed.data() + b * stride, enc.getOut(), enc.obs.pos);
+        }
+    };
+    auto decode = [&]()
+    {
+        for (size_t b = 0; b < nblocks; b++)
+            failed |= chimp_decode_chimpn(compressed.data() + b * stride, sizes[b], items(b), windowLog2, true, nullptr,
+                                          (char *)(decoded.data() + b * blockItems)) != items(b);
+    };
+
+    ChimpBenchStats enct = ChimpBenchStats::of(chimp_bench_time(encode, warmup, reps));
+    ChimpBenchStats dect = ChimpBenchStats::of(chimp_bench_time(decode, warmup, reps));
+    double rawBytes = values.size() * 8.0, compressedBytes = 0;
+    for (uint32_t s : sizes)
+        compressedBytes += s;
+
+    Point p;
+    p.windowLog2 = windowLog2;
+    p.threshold = threshold;
+    p.bitsPerValue = compressedBytes * 8 / values.size();
+    p.encodeMBs = rawBytes / enct.median / 1e6;
+    p.decodeMBs = rawBytes / dect.median / 1e6;
+    p.verified = !failed && memcmp(decoded.data(), values.data(), rawBytes) == 0;
+    return p;
+}
+
+static void usage()
+{
+    cout << "usage: chimp-sweep [--min-window 8] [--max-window 4096] [--offsets -4,-2,0,2] [--block N]\n"
+            "                   [--reps N] [--warmup N] [--values N] [--seed N] [--format text|json|csv]\n"
+            "                   [--output file] dataset\n"
+            "  dataset: a generator, file.csv[:column] or a file of raw little-endian doubles\n"
+            "  thresholds are 6 + log2(window) + offset, the default being offset 0" << endl;
+}
+
+/*
+ * Runs a dataset through ChimpN over a grid of window sizes and threshold
+ * offsets, measuring bits per value and encode and decode throughput, and marks
+ * the points no other point beats on all three.
+ */
+int main(int argc, char *argv[])
+{
+    int minWindow = 8, maxWindow = 4096, reps = 3, warmup = 1;
+    uint32_t blockItems = 3600;
+    size_t nvalues = 1 << 18;
+    uint64_t seed = 1;
+    vector<int> offsets = {-4, -2, 0, 2};
+    string format = "text", output, spec;
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg == "--min-window" && i + 1 < argc)
+            minWindow = atoi(argv[++i]);
+        else if (arg == "--max-window" && i + 1 < argc)
+            maxWindow = atoi(argv[++i]);
+        else if (arg == "--offsets" && i + 1 < argc) {
+            offsets.clear();
+            for (char *p = argv[++i]; *p; p++) {
+                offsets.push_back(strtol(p, &p, 10));
+                if (*p != ',')
+                    break;
+            }
+        } else if (arg == "--block" && i + 1 < argc)
+            blockItems = atoi(argv[++i]);
+        else if (arg == "--reps" && i + 1 < argc)
+            reps = atoi(argv[++i]);
+        else if (arg == "--warmup" && i + 1 < argc)
+            warmup = atoi(argv[++i]);
+        else if (arg == "--values" && i + 1 < argc)
+            nvalues = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--format" && i + 1 < argc)
+            format = argv[++i];
+        else if (arg == "--output" && i + 1 < argc)
+            output = argv[++i];
+        else if (arg[0] == '-' || !spec.empty()) {
+            usage();
+            return -1;
+        } else
+            spec = arg;
+    }
+    if (spec.empty() || reps < 1 || blockItems < 1 || minWindow < 1 || maxWindow > (1 << 16) || offsets.empty()) {
+        usage();
+        return -1;
+    }
+
+    vector<double> values;
+    if (!chimp_bench_load(spec, values, nvalues, seed) || values.empty()) {
+        cerr << "cannot read " << spec << endl;
+        return -1;
+    }
+
+    vector<Point> points;
+    for (int log2 = 0; (1 << log2) <= maxWindow; log2++) {
+        if ((1 << log2) < minWindow)
+            continue;
+        for (int offset : offsets) {
+            // The threshold also sizes indices, at 2^(threshold + 1) ints.
+            int threshold = 6 + log2 + offset;
+            if (threshold < 0 || threshold > 20)
+                continue;
+            points.push_back(measure(values, blockItems, log2, threshold, warmup, reps));
+        }
+    }
+    for (Point &p : points) {
+        p.pareto = true;
+        for (const Point &o : points)
+            p.pareto &= !o.dominates(p);
+    }
+
+    ChimpBenchReport all, frontier;
+    for (const Point &p : points) {
+        ChimpBenchRow row;
+        row.add("dataset", spec)
+            .add("window", (double)(1 << p.windowLog2))
+            .add("threshold", (double)p.threshold)
+            .add("offset", (double)(p.threshold - 6 - p.windowLog2))
+            .add("values", (double)values.size())
+            .add("block", (double)blockItems)
+            .add("bits_per_value", p.bitsPerValue)
+            .add("ratio", 64 / p.bitsPerValue)
+            .add("encode_mb_s", p.encodeMBs)
+            .add("decode_mb_s", p.decodeMBs)
+            .add("verified", p.verified ? "yes" : "no")
+            .add("pareto", p.pareto ? "yes" : "no");
+        all.rows.push_back(row);
+        if (p.pareto)
+            frontier.rows.push_back(row);
+    }
+    sort(frontier.rows.begin(), frontier.rows.end(), [](const ChimpBenchRow &a, const ChimpBenchRow &b)
+         { return atof(a.get("bits_per_value").c_str()) < atof(b.get("bits_per_value").c_str()); });
+
+    ofstream ofs;
+    if (!output.empty())
+        ofs.open(output);
+    ostream &out = output.empty() ? cout : ofs;
+    all.write(out, format);
+    if (format != "json" && format != "csv") {
+        out << "\nPareto frontier (bits per value against encode and decode throughput):\n";
+        frontier.write(out, format);
+    }
+    return 0;
+}
@@ -1,11 +1,13 @@
 #include <iostream>
+#include <cmath>
 #include <chrono>
 #include <string>
 #include <fstream>
+#include <thread>
+#include "chimp-unit.h"
+#include "ChimpLiveBlock.cpp"
+#include "CSVReader-mmap.cpp"
 #define NITEMS 3600
-#include "ChimpN.cpp"
-#include "ChimpNDecompressor.cpp"
-#include "CSVReader.cpp"
 using namespace std::chrono;
 using namespace std;
 
@@ -44,25 +46,26 @@ void testChimp128()
             {
                 break;
             }
-            ChimpN compressor(128);
-            auto starttime = system_clock::now();
-            for(int i = 0; i < 100; i++)
+            // One pass per block: the output buffer only holds NITEMS values.
+            // See chimp-bench for repeated, warmed up measurements.
+            ChimpN compressor(128, NITEMS);
+            auto starttime = steady_clock::now();
             for (double value : values)
             {
                 compressor.addValue(value);
             }
             compressor.close();
-            duration<double> diff = system_clock::now() - starttime;
-            cout << "压缩所耗时间为：" << diff.count() * 1e6 << "us" << endl;
+            nanoseconds diff = duration_cast<nanoseconds>(steady_clock::now() - starttime);
+            encodingDuration += diff.count();
             totalSize += compressor.getSize();
             totalBlocks += 1;
-    
-            ChimpNDecompressor d(compressor.getOut(), 128);
-            
-            auto uncompresstime = system_clock::now();
+
+            ChimpNDecompressor d(compressor.getOut(), 128, NITEMS);
+
+            auto uncompresstime = steady_clock::now();
             vector<double> uncompressedValues = d.getValues();
-            duration<double> uncompressdiff = system_clock::now() - uncompresstime;
-            cout << "解压所耗时间为：" << uncompressdiff.count() * 1e6 << "us" << endl;
+            nanoseconds uncompressdiff = duration_cast<nanoseconds>(steady_clock::now() - uncompresstime);
+            decodingDuration += uncompressdiff.count();
             int diffvalue = 0;
             for (int i = 0; i < values.size(); i++)
             {
@@ -78,12 +81,143 @@ void testChimp128()
         }
         cout << "compressed_rate: " << totalSize * 1.0 / (totalBlocks * NITEMS * 64) << endl;
         cout << "Chimp128: " << filename;
-        printf(" - Bits/value: %.2f, Compression time per block: %.2f, Decompression time per block: %.2f\n", totalSize * 1.0 / (totalBlocks * NITEMS), encodingDuration * 1.0 / totalBlocks, decodingDuration * 1.0 / totalBlocks);
+        printf(" - Bits/value: %.2f, Compression time per block: %.2fus, Decompression time per block: %.2fus\n", totalSize * 1.0 / (totalBlocks * NITEMS), encodingDuration / 1e3 / totalBlocks, decodingDuration / 1e3 / totalBlocks);
     }
 }
 
+/*
+ * Round trips blocks of a few sizes through chimp_compress_data and
+ * chimp_decompress_data, with output buffers of exactly CHIMP_COMPRESS_BOUND
+ * and compressed blocks in buffers of exactly their size.
+ */
+void testBlockSizes()
+{
+    static const uint32_t SIZES[] = {1, 2, 3, 17, NITEMS, NITEMS + 1};
+
+    for (uint32_t n : SIZES)
+    {
+        std::vector<std::vector<double>> inputs(3, std::vector<double>(n));
+        for (uint32_t i = 0; i < n; i++)
+        {
+            inputs[0][i] = 21.5;
+            inputs[1][i] = i % 50 == 7 ? -3.25 : 21.5;
+            inputs[2][i] = round(1000 * sin(i / 10.0)) / 100;
+        }
+
+        int failed = 0;
+        for (const std::vector<double> &values : inputs)
+        {
+            std::vector<char> dest(CHIMP_COMPRESS_BOUND(n * 8));
+            int32_t size = chimp_compress_data((const char *)values.data(), n * 8, dest.data(), dest.size());
+            if (size < 0)
+            {
+                failed++;
+                continue;
+            }
+            std::vector<char> block(dest.begin(), dest.begin() + size);
+            std::vector<double> decoded(n);
+            if (chimp_decompress_data(block.data(), block.size(), (char *)decoded.data(), n * 8) != (int32_t)(n * 8) ||
+                memcmp(decoded.data(), values.data(), n * 8) != 0)
+                failed++;
+        }
+        cout << "Blocks of " << n << " values: " << (failed == 0 ? "ok" : "failed") << endl;
+    }
+}
+
+/*
+ * A block read from a CSV column with a missing field still compresses with
+ * ChimpN, and its gap comes back as the reader's missing() NaN.
+ */
+void testMissingField()
+{
+    const char *filename = "chimp-test-missing.csv";
+    {
+        ofstream csv(filename);
+        for (int i = 0; i < NITEMS; i++)
+        {
+            if (i == 1000)
+                csv << i << ",\n";
+            else
+                csv << i << "," << 20 + (i % 100) / 4.0 << "\n";
+        }
+    }
+    std::vector<double> values(NITEMS);
+    size_t n;
+    {
+        CSVReader reader(filename, ",", 1);
+        n = reader.nextBatch(values.data(), values.size());
+    }
+    remove(filename);
+
+    std::vector<char> block(CHIMP_COMPRESS_BOUND(NITEMS * 8));
+    int32_t size = chimp_compress_data((const char *)values.data(), n * 8, block.data(), block.size());
+    std::vector<double> decoded(NITEMS);
+    double missing = CSVReader::missing();
+    bool ok = n == NITEMS && size > 0 && block[4] == CHIMP_CODEC_CHIMPN &&
+              chimp_decompress_data(block.data(), size, (char *)decoded.data(), n * 8) == (int32_t)(n * 8) &&
+              memcmp(decoded.data(), values.data(), n * 8) == 0 && memcmp(&decoded[1000], &missing, 8) == 0;
+    cout << "Block with a missing field: " << (ok ? "ok" : "failed") << ", " << size << " bytes" << endl;
+}
+
+/*
+ * Appends to a ChimpLiveBlock while two threads take snapshots: every snapshot
+ * must be a prefix of the block being written, and the sealed blocks the series.
+ * Run under -fsanitize=thread too.
+ */
+void testLiveBlock()
+{
+    const uint32_t blockItems = 1000;
+    std::vector<double> values(100 * blockItems);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = (i / 3) * 1.25 + (i % 7 == 0 ? 0.01 : 0);
+
+    std::vector<char> stream;
+    ChimpLiveBlock live([&](const char *block, uint32_t size)
+                        {
+                            size_t offset = stream.size();
+                            stream.resize(offset + CHIMP_FRAME_SIZE + size);
+                            memcpy(stream.data() + offset, &size, CHIMP_FRAME_SIZE);
+                            memcpy(stream.data() + offset + CHIMP_FRAME_SIZE, block, size);
+                        },
+                        blockItems);
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> snapshots(0), bad(0);
+    auto reader = [&]()
+    {
+        std::vector<double> snapshot;
+        while (!done)
+        {
+            uint32_t n = live.snapshot(snapshot);
+            snapshots++;
+            if (n == 0)
+                continue;
+            // The first value tells the block, give or take one.
+            size_t block = (size_t)(snapshot[0] / 1.25 * 3) / blockItems;
+            bool found = false;
+            for (size_t b = block > 0 ? block - 1 : 0; b <= block + 1 && !found; b++)
+                found = b * blockItems + n <= values.size() &&
+                        memcmp(snapshot.data(), values.data() + b * blockItems, n * 8) == 0;
+            bad += !found;
+        }
+    };
+    std::thread r1(reader), r2(reader);
+    for (double v : values)
+        live.append(v);
+    live.flush();
+    done = true;
+    r1.join();
+    r2.join();
+
+    std::vector<double> decoded;
+    bool ok = chimp_decompress_stream(stream.data(), stream.size(), decoded) == 100 && decoded == values && bad == 0;
+    cout << "Live block with concurrent snapshots: " << (ok ? "ok" : "failed") << ", " << snapshots << " snapshots" << endl;
+}
+
 int main()
 {
+    testBlockSizes();
+    testMissingField();
+    testLiveBlock();
     testChimp128();
     return 0;
 }
\ No newline at end of file
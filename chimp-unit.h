@@ -0,0 +1,1541 @@
+#pragma once
+#include "chimp.h"
+#include <cassert>
+#include <cstdio>
+#include <limits.h>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+const int ENCODING_UNALIGNED_BUFFER = -2;
+const int ENCODING_UNSUPPORT_TYPE_WIDTH = -1;
+const int ENCODING_BUFFER_TOO_SMALL = -3;
+const int ENCODING_BUFFER_OVERFLOW = -4;
+const int ENCODING_CORRUPTED_DATA = -5;
+const int ENCODING_MISSING_STATE = -6;
+
+/* The largest window a ChimpWindowState can seed. */
+#define CHIMP_STATE_VALUES 512
+
+/**
+ * The tail of a series, used to seed the window of its next block so that
+ * small blocks do not start cold. Both ends of a stream keep one per series
+ * and feed it every block in order.
+ */
+struct ChimpWindowState
+{
+    /** The last values of the series, oldest first. */
+    uint64_t values[CHIMP_STATE_VALUES];
+    /** How many of values are set. */
+    uint32_t count = 0;
+
+    /**
+     * Appends a block of values, keeping the last CHIMP_STATE_VALUES.
+     */
+    void update(const char *source, uint32_t nitems)
+    {
+        if (nitems >= CHIMP_STATE_VALUES)
+        {
+            memcpy(values, source + (size_t)(nitems - CHIMP_STATE_VALUES) * 8, sizeof(values));
+            count = CHIMP_STATE_VALUES;
+            return;
+        }
+        uint32_t keep = count + nitems > CHIMP_STATE_VALUES ? CHIMP_STATE_VALUES - nitems : count;
+        memmove(values, values + count - keep, keep * 8);
+        memcpy(values + keep, source, nitems * 8);
+        count = keep + nitems;
+    }
+};
+
+/* Kinds of codec objects the memory tracker keeps totals for. */
+enum ChimpMemoryKind
+{
+    CHIMP_MEMORY_ENCODER,
+    CHIMP_MEMORY_DECODER,
+    CHIMP_MEMORY_NKINDS
+};
+
+struct ChimpMemoryTotals
+{
+    int64_t objects;
+    int64_t current;
+    int64_t peak;
+};
+
+/**
+ * Process-wide heap totals of codec objects, by kind. It is off by default;
+ * objects built while it is on report to it until they are destroyed, so that
+ * turning it on or off never leaves totals unbalanced.
+ */
+struct ChimpMemoryTracker
+{
+    struct Kind
+    {
+        std::atomic<int64_t> objects{0};
+        std::atomic<int64_t> current{0};
+        std::atomic<int64_t> peak{0};
+    };
+
+    static std::atomic<bool> &enabled()
+    {
+        static std::atomic<bool> on(false);
+        return on;
+    }
+
+    static Kind *kinds()
+    {
+        static Kind k[CHIMP_MEMORY_NKINDS];
+        return k;
+    }
+
+    static void enable(bool on)
+    {
+        enabled() = on;
+    }
+
+    static void add(int kind, int64_t objects, int64_t bytes)
+    {
+        Kind &k = kinds()[kind];
+        k.objects += objects;
+        int64_t now = k.current += bytes;
+        int64_t peak = k.peak.load();
+        while (now > peak && !k.peak.compare_exchange_weak(peak, now))
+        {
+        }
+    }
+
+    static ChimpMemoryTotals totals(int kind)
+    {
+        Kind &k = kinds()[kind];
+        return {k.objects.load(), k.current.load(), k.peak.load()};
+    }
+
+    /** Starts measuring peaks anew from the current totals. */
+    static void resetPeaks()
+    {
+        for (int kind = 0; kind < CHIMP_MEMORY_NKINDS; kind++)
+            kinds()[kind].peak = kinds()[kind].current.load();
+    }
+};
+
+/**
+ * The heap bytes one codec object holds now and at most, reported to the
+ * tracker if it was on when the object was built.
+ */
+struct ChimpMemoryAccount
+{
+    int kind;
+    bool tracked;
+    size_t current = 0;
+    size_t peak = 0;
+
+    ChimpMemoryAccount(int preKind) : kind(preKind), tracked(ChimpMemoryTracker::enabled())
+    {
+        if (tracked)
+            ChimpMemoryTracker::add(kind, 1, 0);
+    }
+
+    ChimpMemoryAccount(const ChimpMemoryAccount &) = delete;
+    ChimpMemoryAccount &operator=(const ChimpMemoryAccount &) = delete;
+
+    ~ChimpMemoryAccount()
+    {
+        if (tracked)
+            ChimpMemoryTracker::add(kind, -1, -(int64_t)current);
+    }
+
+    void set(size_t bytes)
+    {
+        if (tracked)
+            ChimpMemoryTracker::add(kind, 0, (int64_t)bytes - (int64_t)current);
+        current = bytes;
+        peak = bytes > peak ? bytes : peak;
+    }
+};
+
+/*
+ * Building with -DCHIMP_STATS makes every ChimpN count what its records are
+ * made of; without it the counting compiles out of compressValue().
+ */
+#ifdef CHIMP_STATS
+#define CHIMP_COUNT(statement) statement
+#else
+#define CHIMP_COUNT(statement)
+#endif
+
+/* The four record cases of ChimpN, by their leading flag bits. */
+enum ChimpRecordCase
+{
+    /** 00: the value of a window slot repeated (a run with runs on). */
+    CHIMP_RECORD_REPEAT,
+    /** 01: XOR against the window slot found through indices. */
+    CHIMP_RECORD_WINDOW,
+    /** 10: XOR against the previous value, leading zeros as last time. */
+    CHIMP_RECORD_SAME_LEADING,
+    /** 11: XOR against the previous value with new leading zeros. */
+    CHIMP_RECORD_NEW_LEADING,
+    CHIMP_NRECORDS
+};
+
+/**
+ * How ChimpN wrote its last value, for tracing a block value by value.
+ */
+struct ChimpRecordTrace
+{
+    /** A ChimpRecordCase, or -1 for a first value, written raw. */
+    int record = -1;
+    /** How many values back the reference is, 1 being the previous value. */
+    int distance = 0;
+    /** The XOR with the reference, or the value itself when written raw. */
+    uint64_t xorvalue = 0;
+    /** Leading zeros as encoded (rounded down to a class) and trailing zeros of xorvalue. */
+    int leadingZeros = 0;
+    int trailingZeros = 0;
+    /** Bits of the record; 0 for a repeat that opens or extends a run. */
+    int bits = 0;
+    /** Whether the value only extended the pending run. */
+    bool inRun = false;
+    /** Bits of the run this value ended, which belong to the run's first value. */
+    int runBits = 0;
+};
+
+/**
+ * What the values of a ChimpN cost, since it was built or last cleared; it
+ * carries over reset(), so one encoder reused block after block sums up its
+ * series. The terminator closing each block is counted like any value, so that
+ * headerBits + payloadBits add up to the getSize() of every block.
+ */
+struct ChimpEncoderStats
+{
+    /** Values added, first values and terminators included. */
+    uint64_t values = 0;
+    uint64_t records[CHIMP_NRECORDS] = {};
+    /** Values folded into the run of an earlier repeat record. */
+    uint64_t runValues = 0;
+    /** XOR records by leading zeros, rounded to 0, 8, 12, 16, 18, 20, 22, 24. */
+    uint64_t leading[8] = {};
+    /** XOR records by trailing zeros of the XOR written. */
+    uint64_t trailing[64] = {};
+    /** Values looked up in indices, and how many found a slot still in the window. */
+    uint64_t lookups = 0;
+    uint64_t inWindow = 0;
+    /** Flags, leading zero and index fields and run lengths. */
+    uint64_t headerBits = 0;
+    /** First values and the significant bits of XORs. */
+    uint64_t payloadBits = 0;
+
+    void clear()
+    {
+        *this = ChimpEncoderStats();
+    }
+
+    void merge(const ChimpEncoderStats &o)
+    {
+        values += o.values;
+        for (int k = 0; k < CHIMP_NRECORDS; k++)
+            records[k] += o.records[k];
+        runValues += o.runValues;
+        for (int k = 0; k < 8; k++)
+            leading[k] += o.leading[k];
+        for (int k = 0; k < 64; k++)
+            trailing[k] += o.trailing[k];
+        lookups += o.lookups;
+        inWindow += o.inWindow;
+        headerBits += o.headerBits;
+        payloadBits += o.payloadBits;
+    }
+
+    /** Share of lookups that found a window slot, referenced or not. */
+    double hitRate() const
+    {
+        return lookups == 0 ? 0 : (double)inWindow / lookups;
+    }
+
+    /** Share of lookups that became window reference records. */
+    double useRate() const
+    {
+        return lookups == 0 ? 0 : (double)records[CHIMP_RECORD_WINDOW] / lookups;
+    }
+
+    /**
+     * Calls f(name, value) for every counter, for export to a metrics system.
+     * Histograms are flattened to name_bucket.
+     */
+    template <typename F>
+    void visit(F f) const
+    {
+        static const char *const cases[CHIMP_NRECORDS] = {"repeat", "window", "same_leading", "new_leading"};
+        static const int rounded[8] = {0, 8, 12, 16, 18, 20, 22, 24};
+        char name[32];
+
+        f("values", (double)values);
+        for (int k = 0; k < CHIMP_NRECORDS; k++)
+        {
+            snprintf(name, sizeof(name), "records_%s", cases[k]);
+            f(name, (double)records[k]);
+        }
+        f("run_values", (double)runValues);
+        for (int k = 0; k < 8; k++)
+        {
+            snprintf(name, sizeof(name), "leading_%d", rounded[k]);
+            f(name, (double)leading[k]);
+        }
+        for (int k = 0; k < 64; k++)
+        {
+            snprintf(name, sizeof(name), "trailing_%d", k);
+            f(name, (double)trailing[k]);
+        }
+        f("window_lookups", (double)lookups);
+        f("window_hit_rate", hitRate());
+        f("window_use_rate", useRate());
+        f("header_bits", (double)headerBits);
+        f("payload_bits", (double)payloadBits);
+    }
+};
+
+struct ChimpN
+{
+    const uint64_t NAN_LONG = 0x7ff8000000000000L;
+    int storedLeadingZeros = INT_MAX;
+    uint64_t *storedValues;
+    bool first = true;
+    int size;
+    int previousValuesLog2;
+    int threshold;
+
+    short leadingRepresentation[64] = {0, 0, 0, 0, 0, 0, 0, 0,
+                                       1, 1, 1, 1, 2, 2, 2, 2,
+                                       3, 3, 4, 4, 5, 5, 6, 6,
+                                       7, 7, 7, 7, 7, 7, 7, 7,
+                                       7, 7, 7, 7, 7, 7, 7, 7,
+                                       7, 7, 7, 7, 7, 7, 7, 7,
+                                       7, 7, 7, 7, 7, 7, 7, 7,
+                                       7, 7, 7, 7, 7, 7, 7, 7};
+
+    short leadingRound[64] = {0, 0, 0, 0, 0, 0, 0, 0,
+                              8, 8, 8, 8, 12, 12, 12, 12,
+                              16, 16, 18, 18, 20, 20, 22, 22,
+                              24, 24, 24, 24, 24, 24, 24, 24,
+                              24, 24, 24, 24, 24, 24, 24, 24,
+                              24, 24, 24, 24, 24, 24, 24, 24,
+                              24, 24, 24, 24, 24, 24, 24, 24,
+                              24, 24, 24, 24, 24, 24, 24, 24};
+    //      final static short FIRST_DELTA_BITS = 27;
+
+    //      BitOutput obs;
+
+    // OutputBitStream obs;
+    // std::vector<uint8_t>obstr(8000, 0);
+
+    OutputBitStream obs;
+
+    int previousValues;
+
+    int setLsb;
+
+    int *indices;
+
+    int index = 0;
+
+    /**
+     * Index of the block's first value. It starts a whole window past any
+     * index stored in indices, so that stale entries read as out of the window.
+     */
+    int base = 0;
+
+    int current = 0;
+
+    int flagOneSize;
+
+    int flagZeroSize;
+
+    /** Whether repeat records carry a run length (see writeRun()). */
+    bool runs;
+
+    /** Pending run: runLength copies of runValue, referring to window slot runIndex. */
+    uint64_t runValue;
+
+    int runIndex;
+
+    uint32_t runLength = 0;
+
+    /** Longest run a single record holds, so that its length fits 31 bits. */
+    const uint32_t MAX_RUN = 0x7fffffff;
+
+    /** Most values a block can hold with this encoder's output buffer. */
+    uint32_t capacity;
+
+    ChimpMemoryAccount memory{CHIMP_MEMORY_ENCODER};
+
+#ifdef CHIMP_STATS
+    ChimpEncoderStats stats;
+    ChimpRecordTrace trace;
+#endif
+
+    // We should have access to the series?
+    ChimpN(int preValues, uint32_t NITEMS) : ChimpN(preValues, NITEMS, 6 + (int)(log(preValues) / log(2)))
+    {
+    }
+
+    /**
+     * @param preThreshold trailing zeros a window reference must exceed to be
+     *        used instead of the previous value; it also sizes indices.
+     * @param preRuns collapse runs of repeated values into run-length records.
+     */
+    ChimpN(int preValues, uint32_t NITEMS, int preThreshold, bool preRuns = false)
+    {
+        // A record never takes more than 69 bits, so 9 bytes per value plus the
+        // first value and the terminator always fit, even for random bits.
+        uint8_t *obstr = new uint8_t[9 * NITEMS + 32];
+        memory.set(9 * (size_t)NITEMS + 32);
+        obs = OutputBitStream(obstr);
+        obs.writtenBits = 0;
+        size = 0;
+        this->capacity = NITEMS;
+        this->previousValues = preValues;
+        this->previousValuesLog2 = (int)(log(previousValues) / log(2));
+        this->threshold = preThreshold;
+        this->runs = preRuns;
+        this->setLsb = (int)pow(2, threshold + 1) - 1;
+        this->indices = new int[(int)pow(2, threshold + 1)]();
+        memory.set(memory.current + (setLsb + 1) * sizeof(int));
+        this->base = previousValues;
+        this->index = base;
+        this->storedValues = new uint64_t[previousValues];
+        memory.set(memory.current + previousValues * sizeof(uint64_t));
+        this->flagZeroSize = previousValuesLog2 + 2;
+        this->flagOneSize = previousValuesLog2 + 11;
+    }
+
+    ChimpN(const ChimpN &) = delete;
+    ChimpN &operator=(const ChimpN &) = delete;
+
+    ~ChimpN()
+    {
+        delete[] obs.buffer;
+        delete[] indices;
+        delete[] storedValues;
+    }
+
+    uint8_t *getOut()
+    {
+        return obs.buffer;
+    }
+
+    /**
+     * Starts a new block of at most capacity values, keeping the buffers.
+     */
+    void reset()
+    {
+        obs = OutputBitStream(obs.buffer);
+        obs.writtenBits = 0;
+        size = 0;
+        first = true;
+        current = 0;
+        storedLeadingZeros = INT_MAX;
+        runLength = 0;
+        // Moving base past the last block saves clearing indices, but for
+        // the rare wrap of the int indices.
+        base = (index / previousValues + 2) * previousValues;
+        if (base > INT_MAX / 2)
+        {
+            memset(indices, 0, (setLsb + 1) * sizeof(int));
+            base = previousValues;
+        }
+        index = base;
+    }
+
+    /**
+     * Saves the window, oldest value first, so that the next block of the
+     * series can be seeded with it.
+     */
+    void checkpoint(ChimpWindowState &state)
+    {
+        if (first)
+        {
+            state.count = 0;
+            return;
+        }
+        uint32_t n = index - base + 1 < previousValues ? index - base + 1 : previousValues;
+        if (n > CHIMP_STATE_VALUES)
+            n = CHIMP_STATE_VALUES;
+        for (uint32_t j = 0; j < n; j++)
+            state.values[j] = storedValues[(index - n + 1 + j) % previousValues];
+        state.count = n;
+    }
+
+    /**
+     * Seeds the window with the tail of the previous block, so that the first
+     * value is compressed against it instead of written raw. Must be called
+     * before any value is added; ChimpNDecompressorT::restore() must be given
+     * the same state.
+     */
+    void restore(const ChimpWindowState &state)
+    {
+        uint32_t n = state.count < (uint32_t)previousValues ? state.count : previousValues;
+        if (n == 0)
+            return;
+        const uint64_t *tail = state.values + state.count - n;
+        for (uint32_t j = 0; j < n; j++)
+        {
+            storedValues[j] = tail[j];
+            indices[(int)tail[j] & setLsb] = base + j;
+        }
+        index = base + n - 1;
+        current = n - 1;
+        first = false;
+    }
+
+    /**
+     * Adds a new uint64_t value to the series. Note, values must be inserted in order.
+     *
+     * @param value next floating point value in the series
+     */
+
+    void addValue(uint64_t value)
+    {
+        if (first)
+        {
+            writeFirst(value);
+        }
+        else
+        {
+            compressValue(value);
+        }
+    }
+
+    /**
+     * Adds a new double value to the series. Note, values must be inserted in order.
+     *
+     * @param value next floating point value in the series
+     */
+
+    void addValue(double value)
+    {
+        if (first)
+        {
+            writeFirst(*((uint64_t *)&value));
+        }
+        else
+        {
+            compressValue(*((uint64_t *)&value));
+        }
+    }
+
+    void writeFirst(uint64_t value)
+    {
+        first = false;
+        storedValues[current] = value;
+        obs.writeLong(storedValues[current], 64);
+        indices[(int)value & setLsb] = index;
+        size += 64;
+        CHIMP_COUNT(stats.values++; stats.payloadBits += 64);
+        CHIMP_COUNT(trace = ChimpRecordTrace(); trace.xorvalue = value; trace.bits = 64);
+    }
+
+    /**
+     * Closes the block and writes the remaining stuff to the BitOutput.
+     */
+
+    void close()
+    {
+        // C++ the unlike float8 value
+        addValue(NAN_LONG);
+        if (runLength > 0)
+            writeRun();
+        obs.writeBit(false);
+        obs.flush();
+    }
+
+    /**
+     * Writes the pending run: a repeat record for its first value, then a 0 bit
+     * if the run is a single value, or a 1 bit, the 5-bit width of
+     * runLength - 2 and runLength - 2 itself.
+     */
+    void writeRun()
+    {
+        CHIMP_COUNT(int before = size);
+        obs.writeInt(runIndex, this->flagZeroSize);
+        size += this->flagZeroSize;
+        if (runLength == 1)
+        {
+            obs.writeBit(false);
+            size += 1;
+        }
+        else
+        {
+            int extra = runLength - 2;
+            int width = extra == 0 ? 0 : 32 - __builtin_clz(extra);
+            obs.writeInt(32 + width, 6);
+            obs.writeInt(extra, width);
+            size += 6 + width;
+        }
+        CHIMP_COUNT(stats.records[CHIMP_RECORD_REPEAT]++; stats.runValues += runLength - 1;
+                    stats.headerBits += size - before; trace.runBits = size - before);
+        runLength = 0;
+    }
+
+    void compressValue(uint64_t value)
+    {
+        int key = (int)value & setLsb;
+        CHIMP_COUNT(stats.values++; trace = ChimpRecordTrace(); trace.trailingZeros = 64);
+        if (runLength > 0)
+        {
+            if (value == runValue && runLength < MAX_RUN)
+            {
+                CHIMP_COUNT(trace.record = CHIMP_RECORD_REPEAT; trace.distance = 1; trace.inRun = true);
+                runLength++;
+                current = (current + 1) % previousValues;
+                storedValues[current] = value;
+                index++;
+                indices[key] = index;
+                return;
+            }
+            writeRun();
+        }
+
+        uint64_t xorvalue;
+        int previousIndex;
+        int trailingZeros = 0;
+        int currIndex = indices[key];
+        CHIMP_COUNT(stats.lookups++; int reference = index; int before = size);
+        if ((index - currIndex) < previousValues)
+        {
+            CHIMP_COUNT(stats.inWindow++);
+            uint64_t tempXor = value ^ storedValues[currIndex % previousValues];
+            trailingZeros = __builtin_ctzll(tempXor);
+            if (trailingZeros > threshold)
+            {
+                previousIndex = currIndex % previousValues;
+                xorvalue = tempXor;
+                CHIMP_COUNT(reference = currIndex);
+            }
+            else
+            {
+                previousIndex = index % previousValues;
+                xorvalue = storedValues[previousIndex] ^ value;
+            }
+        }
+        else
+        {
+            previousIndex = index % previousValues;
+            xorvalue = storedValues[previousIndex] ^ value;
+        }
+
+        if (xorvalue == 0)
+        {
+            if (runs)
+            {
+                runValue = value;
+                runIndex = previousIndex;
+                runLength = 1;
+            }
+            else
+            {
+                obs.writeInt(previousIndex, this->flagZeroSize);
+                size += this->flagZeroSize;
+                CHIMP_COUNT(stats.records[CHIMP_RECORD_REPEAT]++; stats.headerBits += flagZeroSize);
+            }
+            storedLeadingZeros = 65;
+            CHIMP_COUNT(trace.record = CHIMP_RECORD_REPEAT);
+        }
+        else
+        {
+            int leadingZeros = leadingRound[__builtin_clzll(xorvalue)];
+            CHIMP_COUNT(trace.leadingZeros = leadingZeros; trace.trailingZeros = __builtin_ctzll(xorvalue));
+            CHIMP_COUNT(stats.leading[leadingRepresentation[leadingZeros]]++;
+                        stats.trailing[__builtin_ctzll(xorvalue)]++);
+
+            if (trailingZeros > threshold)
+            {
+                int significantBits = 64 - leadingZeros - trailingZeros;
+                obs.writeInt(512 * (previousValues + previousIndex) + 64 * leadingRepresentation[leadingZeros] + significantBits, this->flagOneSize);
+                obs.writeLong(xorvalue >> trailingZeros, significantBits); // Store the meaningful bits of XOR
+                size += significantBits + this->flagOneSize;
+                storedLeadingZeros = 65;
+                CHIMP_COUNT(stats.records[CHIMP_RECORD_WINDOW]++; stats.headerBits += flagOneSize;
+                            stats.payloadBits += significantBits; trace.record = CHIMP_RECORD_WINDOW);
+            }
+            else if (leadingZeros == storedLeadingZeros)
+            {
+                obs.writeInt(2, 2);
+                int significantBits = 64 - leadingZeros;
+                obs.writeLong(xorvalue, significantBits);
+                size += 2 + significantBits;
+                CHIMP_COUNT(stats.records[CHIMP_RECORD_SAME_LEADING]++; stats.headerBits += 2;
+                            stats.payloadBits += significantBits; trace.record = CHIMP_RECORD_SAME_LEADING);
+            }
+            else
+            {
+                storedLeadingZeros = leadingZeros;
+                int significantBits = 64 - leadingZeros;
+                obs.writeInt(24 + leadingRepresentation[leadingZeros], 5);
+                obs.writeLong(xorvalue, significantBits);
+                size += 5 + significantBits;
+                CHIMP_COUNT(stats.records[CHIMP_RECORD_NEW_LEADING]++; stats.headerBits += 5;
+                            stats.payloadBits += significantBits; trace.record = CHIMP_RECORD_NEW_LEADING);
+            }
+        }
+        CHIMP_COUNT(trace.distance = index + 1 - reference; trace.xorvalue = xorvalue; trace.bits = size - before);
+        current = (current + 1) % previousValues;
+        storedValues[current] = value;
+        index++;
+        indices[key] = index;
+    }
+
+    int getSize()
+    {
+        return size;
+    }
+
+    /** Heap bytes held: the output buffer, indices and the window. */
+    size_t memoryUsage() const
+    {
+        return memory.current;
+    }
+
+    /**
+     * A ChimpN only allocates while it is built, and reset() reuses its
+     * buffers, so once built its peak is its current usage.
+     */
+    size_t peakMemoryUsage() const
+    {
+        return memory.peak;
+    }
+
+    /** The record statistics, or nullptr when built without CHIMP_STATS. */
+    const ChimpEncoderStats *getStats() const
+    {
+#ifdef CHIMP_STATS
+        return &stats;
+#else
+        return nullptr;
+#endif
+    }
+};
+
+/**
+ * Decompresses a compressed stream created by the Compressor. Returns pairs of timestamp and floating point value.
+ *
+ * A non-negative WindowLog2 specializes the decoder to a window of
+ * 1 << WindowLog2 values, turning ring and index arithmetic into constants.
+ */
+template <int WindowLog2 = -1>
+struct ChimpNDecompressorT
+{
+    int storedLeadingZeros = INT_MAX;
+    int storedTrailingZeros = 0;
+    uint64_t storedVal = 0;
+    uint64_t *storedValues;
+    int current = 0;
+    bool first = true;
+    bool endOfStream = false;
+
+    InputBitStream in;
+    int previousValues;
+    int previousValuesLog2;
+    int initialFill;
+
+    short leadingRepresentation[8] = {0, 8, 12, 16, 18, 20, 22, 24};
+
+    const uint64_t NAN_LONG = 0x7ff8000000000000L;
+    std::vector<double> list;
+
+    uint32_t numItems;
+
+    /** Whether repeat records carry a run length. */
+    bool runs;
+
+    /** Copies of storedVal still owed by the current run. */
+    uint32_t runRemaining = 0;
+
+    ChimpMemoryAccount memory{CHIMP_MEMORY_DECODER};
+
+    //  parameter name must be diff with member data,
+    // otherwise using this->namexxx = namexxx
+    /**
+     * Decodes NITEMS values from the preBytes bytes at bs, reading zeros past
+     * them; without a size, the buffer must hold the whole stream plus two bytes.
+     */
+    ChimpNDecompressorT(uint8_t *bs, int preValues, uint32_t NITEMS, bool preRuns = false, int preBytes = INT_MAX)
+    {
+        runs = preRuns;
+        in = InputBitStream(bs, NITEMS);
+        in.avail = preBytes;
+        this->numItems = NITEMS;
+        previousValues = preValues;
+        previousValuesLog2 = (int)(log(previousValues) / log(2));
+        initialFill = windowLog2() + 9;
+        storedValues = new uint64_t[previousValues];
+        memory.set(previousValues * sizeof(uint64_t));
+    }
+
+    ChimpNDecompressorT(const ChimpNDecompressorT &) = delete;
+    ChimpNDecompressorT &operator=(const ChimpNDecompressorT &) = delete;
+
+    ~ChimpNDecompressorT()
+    {
+        delete[] storedValues;
+    }
+
+    int windowLog2() const
+    {
+        return WindowLog2 >= 0 ? WindowLog2 : previousValuesLog2;
+    }
+
+    int windowMask() const
+    {
+        return (1 << windowLog2()) - 1;
+    }
+
+    /**
+     * Heap bytes held: the window and the values getValues() decoded last. The
+     * peak also counts the copy getValues() returns, while both exist.
+     */
+    size_t memoryUsage() const
+    {
+        return memory.current;
+    }
+
+    size_t peakMemoryUsage() const
+    {
+        return memory.peak;
+    }
+
+    /**
+     * Returns the next pair in the time series, if available.
+     *
+     * @return Pair if there's next value, null if series is done.
+     */
+    double readValue()
+    {
+        next();
+
+        if (endOfStream)
+        {
+            return -1.0;
+        }
+        return *((double *)&storedVal);
+    }
+
+    std::vector<double> getValues()
+    {
+        // Reserved up front, so that list does not grow while decoding.
+        list.clear();
+        list.reserve(numItems);
+        memory.set((previousValues + list.capacity()) * sizeof(double));
+        double value = readValue();
+        int ct = 0;
+
+        while (ct < numItems && !endOfStream)
+        {
+            list.push_back(value);
+            value = readValue();
+            ct++;
+        }
+        std::vector<double> values(list);
+        memory.set((previousValues + list.capacity() + values.capacity()) * sizeof(double));
+        memory.set((previousValues + list.capacity()) * sizeof(double));
+        return values;
+    }
+
+    /**
+     * Decodes up to numItems values straight into out.
+     *
+     * @return the number of values decoded.
+     */
+    uint32_t getValues(double *out)
+    {
+        double value = readValue();
+        uint32_t ct = 0;
+
+        while (ct < numItems && !endOfStream)
+        {
+            out[ct++] = value;
+            if (runRemaining > 0)
+            {
+                uint32_t n = runRemaining < numItems - ct ? runRemaining : numItems - ct;
+                std::fill(out + ct, out + ct + n, value);
+                repeatStored(n);
+                runRemaining -= n;
+                ct += n;
+            }
+            value = readValue();
+        }
+        return ct;
+    }
+
+    /**
+     * Seeds the window the way ChimpN::restore() does.
+     */
+    void restore(const ChimpWindowState &state)
+    {
+        uint32_t n = state.count < (uint32_t)windowMask() + 1 ? state.count : windowMask() + 1;
+        if (n == 0)
+            return;
+        memcpy(storedValues, state.values + state.count - n, n * 8);
+        current = n - 1;
+        storedVal = storedValues[current];
+        first = false;
+    }
+
+    /**
+     * Pushes n copies of storedVal into the window.
+     */
+    void repeatStored(uint32_t n)
+    {
+        if (n > (uint32_t)windowMask())
+        {
+            std::fill(storedValues, storedValues + windowMask() + 1, storedVal);
+            current = (current + n) & windowMask();
+            return;
+        }
+        while (n-- != 0)
+        {
+            current = (current + 1) & windowMask();
+            storedValues[current] = storedVal;
+        }
+    }
+
+    void next()
+    {
+        if (first)
+        {
+            first = false;
+            storedVal = in.readLong(64);
+            storedValues[current] = storedVal;
+            if (storedValues[current] == NAN_LONG)
+            {
+                endOfStream = true;
+                return;
+            }
+        }
+        else if (runRemaining > 0)
+        {
+            runRemaining--;
+            repeatStored(1);
+        }
+        else
+        {
+            nextValue();
+        }
+    }
+
+    void nextValue()
+    {
+        // Read value
+        int flag = in.readInt(2);
+        uint64_t value;
+        switch (flag)
+        {
+        case 3:
+            storedLeadingZeros = leadingRepresentation[in.readInt(3)];
+            value = in.readLong(64 - storedLeadingZeros);
+            value = storedVal ^ value;
+
+            if (value == NAN_LONG)
+            {
+                endOfStream = true;
+                return;
+            }
+            else
+            {
+                storedVal = value;
+                current = (current + 1) & windowMask();
+                storedValues[current] = storedVal;
+            }
+            break;
+        case 2:
+            value = in.readLong(64 - storedLeadingZeros);
+            value = storedVal ^ value;
+            if (value == NAN_LONG)
+            {
+                endOfStream = true;
+                return;
+            }
+            else
+            {
+                storedVal = value;
+                current = (current + 1) & windowMask();
+                storedValues[current] = storedVal;
+            }
+            break;
+        case 1:
+        {
+            int fill = initialFill;
+            int temp = in.readInt(fill);
+            int index = temp >> (fill -= windowLog2()) & windowMask();
+            storedLeadingZeros = leadingRepresentation[temp >> (fill -= 3) & (1 << 3) - 1];
+            int significantBits = temp >> (fill -= 6) & (1 << 6) - 1;
+            storedVal = storedValues[index];
+            if (significantBits == 0)
+            {
+                significantBits = 64;
+            }
+            storedTrailingZeros = 64 - significantBits - storedLeadingZeros;
+            value = in.readLong(64 - storedLeadingZeros - storedTrailingZeros);
+            value <<= storedTrailingZeros;
+            value = storedVal ^ value;
+            if (value == NAN_LONG)
+            {
+                endOfStream = true;
+                return;
+            }
+            else
+            {
+                storedVal = value;
+                current = (current + 1) & windowMask();
+                storedValues[current] = storedVal;
+            }
+            break;
+        }
+        default:
+            // else -> same value as before
+            storedVal = storedValues[(int)in.readLong(windowLog2())];
+            if (runs && in.readBit())
+            {
+                int width = in.readInt(5);
+                runRemaining = 1 + (width == 0 ? 0 : in.readInt(width));
+            }
+            current = (current + 1) & windowMask();
+            storedValues[current] = storedVal;
+            break;
+        }
+    }
+};
+
+typedef ChimpNDecompressorT<> ChimpNDecompressor;
+
+#define WINDOW_SIZE 128
+
+/*
+ * Every compressed block starts with the number of items, followed by a
+ * codec tag, the log2 of the ChimpN window and the threshold the payload was
+ * encoded with, and CHIMP_FLAG_* bits.
+ */
+#define CHIMP_HEADER_SIZE (sizeof(uint32_t) + 4)
+
+/* Worst case compressed size: a raw block plus its header. */
+#define CHIMP_COMPRESS_BOUND(source_size) ((source_size) + CHIMP_HEADER_SIZE)
+
+const uint8_t CHIMP_CODEC_RAW = 0;
+const uint8_t CHIMP_CODEC_CHIMPN = 1;
+/* A base value, the number of exceptions, then (uint32_t position, value) pairs. */
+const uint8_t CHIMP_CODEC_CONSTANT = 2;
+
+/* Repeat records carry a run length. */
+const uint8_t CHIMP_FLAG_RUNS = 0x01;
+/* The window is seeded with the tail of the previous block of the series. */
+const uint8_t CHIMP_FLAG_CONTINUATION = 0x02;
+
+/* Keep the smallest encoding. */
+const int CHIMP_POLICY_SMALLEST = 0;
+/* Keep the fastest codec to decode among those close to the smallest. */
+const int CHIMP_POLICY_FASTEST_DECODE = 1;
+
+/* With CHIMP_POLICY_FASTEST_DECODE a codec may be 1/8 larger than the smallest. */
+#define CHIMP_FAST_DECODE_SLACK 8
+
+/* Number of leading values trial-encoded to pick the window of a block. */
+#define CHIMP_SAMPLE_SIZE 1024
+
+/* Blocks with at most one exception per 256 values are stored as constant. */
+#define CHIMP_EXCEPTION_RATIO 256
+
+#define CHIMP_EXCEPTION_SIZE (sizeof(uint32_t) + sizeof(uint64_t))
+
+struct ChimpWindowCandidate
+{
+    uint8_t windowLog2;
+    uint8_t threshold;
+};
+
+/*
+ * Ordered from the fastest to the slowest to decode: Chimp, then ChimpN with
+ * growing windows. Small windows suit smooth series, large ones periodic series
+ * with long periods. Each window is tried with its default threshold
+ * (6 + windowLog2) and, where it helps on noisy data, a lower one.
+ */
+static const ChimpWindowCandidate CHIMP_WINDOWS[] = {
+    {0, 6},
+    {4, 10},
+    {7, 13},
+    {7, 11},
+    {9, 15},
+};
+
+#define CHIMP_NWINDOWS (sizeof(CHIMP_WINDOWS) / sizeof(CHIMP_WINDOWS[0]))
+
+/*
+ * Encodes nitems values with c, giving up as soon as the output reaches limit
+ * bytes, or on a value the decoder would take for the NaN terminator.
+ * ret: the encoded size in bytes, or UINT32_MAX if it gave up.
+ */
+static uint32_t
+chimp_trial_encode(ChimpN &c, const char *source, uint32_t nitems, uint32_t limit)
+{
+    uint64_t limitBits = (uint64_t)limit * 8;
+
+    for (uint32_t i = 0; i < nitems; i++)
+    {
+        uint64_t value = *((uint64_t *)(source + i * 8));
+        if (value == c.NAN_LONG)
+            return UINT32_MAX;
+        c.addValue(value);
+        if ((uint64_t)c.getSize() >= limitBits)
+            return UINT32_MAX;
+    }
+    c.close();
+    return (uint32_t)c.obs.pos < limit ? c.obs.pos : UINT32_MAX;
+}
+
+/*
+ * Picks, among sizes ordered from the fastest to the slowest codec to decode,
+ * the smallest one or, with CHIMP_POLICY_FASTEST_DECODE, the fastest one close
+ * enough to it.
+ */
+static size_t
+chimp_pick(const uint32_t *sizes, size_t n, int policy)
+{
+    size_t best = 0;
+
+    for (size_t k = 1; k < n; k++)
+    {
+        if (sizes[k] < sizes[best])
+            best = k;
+    }
+    if (policy == CHIMP_POLICY_FASTEST_DECODE && sizes[best] != UINT32_MAX)
+    {
+        for (size_t k = 0; k < best; k++)
+        {
+            if (sizes[k] <= sizes[best] + sizes[best] / CHIMP_FAST_DECODE_SLACK)
+                return k;
+        }
+    }
+    return best;
+}
+
+/*
+ * Counts the values of the block that differ from base, giving up past cap.
+ * ret: the number of exceptions, or UINT32_MAX if there are more than cap.
+ */
+static uint32_t
+chimp_count_exceptions(const char *source, uint32_t nitems, uint64_t base, uint32_t cap)
+{
+    const uint64_t *values = (const uint64_t *)source;
+    uint32_t exceptions = 0;
+
+    for (uint32_t i = 0; i < nitems; i++)
+    {
+        if (values[i] != base && ++exceptions > cap)
+            return UINT32_MAX;
+    }
+    return exceptions;
+}
+
+/*
+ * Writes the block as a constant block if all but a few of its values equal
+ * its first, middle or last value.
+ * ret: the payload size, 0 if the block is not near-constant, or a negative
+ * ENCODING_* error.
+ */
+static int32_t
+chimp_encode_constant(const char *source, uint32_t nitems, char *dest, uint32_t dst_size)
+{
+    const uint64_t *values = (const uint64_t *)source;
+    uint32_t cap = nitems / CHIMP_EXCEPTION_RATIO;
+
+    if (nitems == 0)
+        return 0;
+
+    uint32_t probes[3] = {0, nitems / 2, nitems - 1};
+    uint64_t base = values[0];
+    uint32_t exceptions = chimp_count_exceptions(source, nitems, base, cap);
+    for (int k = 1; k < 3 && exceptions == UINT32_MAX; k++)
+    {
+        if (values[probes[k]] == values[probes[k - 1]])
+            continue;
+        base = values[probes[k]];
+        exceptions = chimp_count_exceptions(source, nitems, base, cap);
+    }
+    if (exceptions == UINT32_MAX)
+        return 0;
+
+    size_t bytesize = sizeof(uint64_t) + sizeof(uint32_t) + exceptions * CHIMP_EXCEPTION_SIZE;
+    if (bytesize > dst_size)
+        return ENCODING_BUFFER_TOO_SMALL;
+
+    char *writePos = dest;
+    *((uint64_t *)(writePos)) = base;
+    writePos += sizeof(uint64_t);
+    *((uint32_t *)(writePos)) = exceptions;
+    writePos += sizeof(uint32_t);
+    for (uint32_t i = 0; exceptions != 0; i++)
+    {
+        if (values[i] != base)
+        {
+            *((uint32_t *)(writePos)) = i;
+            *((uint64_t *)(writePos + sizeof(uint32_t))) = values[i];
+            writePos += CHIMP_EXCEPTION_SIZE;
+            exceptions--;
+        }
+    }
+    return bytesize;
+}
+
+/**
+ * The encoders chimp_compress_data_ex() tries, kept between calls so that a
+ * caller compressing block after block allocates them once. A context must not
+ * be shared between threads.
+ */
+struct ChimpCompressContext
+{
+    std::unique_ptr<ChimpN> trials[CHIMP_NWINDOWS];
+    std::unique_ptr<ChimpN> encoders[CHIMP_NWINDOWS];
+
+    ChimpCompressContext()
+    {
+    }
+
+    /**
+     * Creates every encoder up front for blocks of up to capacity values, so
+     * that no later call allocates.
+     */
+    ChimpCompressContext(uint32_t capacity)
+    {
+        for (size_t k = 0; k < CHIMP_NWINDOWS; k++)
+        {
+            trial(k);
+            encoder(k, capacity);
+        }
+    }
+
+    /** Heap bytes held by the encoders created so far. */
+    size_t memoryUsage() const
+    {
+        size_t bytes = 0;
+        for (size_t k = 0; k < CHIMP_NWINDOWS; k++)
+        {
+            bytes += trials[k] ? trials[k]->memoryUsage() : 0;
+            bytes += encoders[k] ? encoders[k]->memoryUsage() : 0;
+        }
+        return bytes;
+    }
+
+    /** The sampling encoder of window k, reset. */
+    ChimpN &trial(size_t k)
+    {
+        return get(trials[k], k, CHIMP_SAMPLE_SIZE);
+    }
+
+    /** The encoder of window k for a whole block of nitems values, reset. */
+    ChimpN &encoder(size_t k, uint32_t nitems)
+    {
+        return get(encoders[k], k, nitems);
+    }
+
+    static ChimpN &get(std::unique_ptr<ChimpN> &c, size_t k, uint32_t nitems)
+    {
+        if (c && c->capacity >= nitems)
+        {
+            c->reset();
+            return *c;
+        }
+        // Freed first, so that the old and the new encoder are never held at once.
+        c.reset();
+        c.reset(new ChimpN(1 << CHIMP_WINDOWS[k].windowLog2, nitems, CHIMP_WINDOWS[k].threshold, true));
+        return *c;
+    }
+};
+
+/*
+ * Samples the start of the block to pick a window size and threshold, encodes
+ * the block with them and keeps the result unless raw passthrough wins under
+ * policy. A block never takes more than its raw size plus the header.
+ *
+ * With a state, ChimpN blocks are encoded against the tail of the previous
+ * block, and the state then moves on to the tail of this one. With a context,
+ * the encoders are reused instead of allocated for the call.
+ *
+ * ret: the compressed size, or a negative ENCODING_* error.
+ */
+inline int32_t
+chimp_compress_data_ex(const char *source, uint32_t source_size,
+                       char *dest, uint32_t dst_size, int policy, ChimpWindowState *state,
+                       ChimpCompressContext *ctx = nullptr)
+{
+    uint32_t nitems;
+
+    nitems = source_size >> 3;
+
+    if (CHIMP_HEADER_SIZE > dst_size)
+        return ENCODING_BUFFER_TOO_SMALL;
+
+    // Constant and near-constant blocks skip the trial encodings altogether,
+    // as long as they come out smaller than raw and fit; otherwise (a block of
+    // one value, or a buffer of CHIMP_COMPRESS_BOUND) raw or ChimpN is used.
+    uint32_t constroom = dst_size - CHIMP_HEADER_SIZE;
+    if (nitems > 0 && constroom >= nitems * 8)
+        constroom = nitems * 8 - 1;
+    int32_t constsize = chimp_encode_constant(source, nitems, dest + CHIMP_HEADER_SIZE, constroom);
+    if (constsize > 0)
+    {
+        *((uint32_t *)(dest)) = nitems;
+        dest[4] = CHIMP_CODEC_CONSTANT;
+        dest[5] = 0;
+        dest[6] = 0;
+        dest[7] = 0;
+        if (state != nullptr)
+            state->update(source, nitems);
+        return constsize + CHIMP_HEADER_SIZE;
+    }
+
+    ChimpCompressContext local;
+    if (ctx == nullptr)
+        ctx = &local;
+
+    bool seeded = state != nullptr && state->count > 0;
+    uint32_t nsample = nitems < CHIMP_SAMPLE_SIZE ? nitems : CHIMP_SAMPLE_SIZE;
+    uint32_t sizes[CHIMP_NWINDOWS];
+    ChimpN *trials[CHIMP_NWINDOWS];
+
+    for (size_t k = 0; k < CHIMP_NWINDOWS; k++)
+    {
+        trials[k] = &ctx->trial(k);
+        if (seeded)
+            trials[k]->restore(*state);
+        sizes[k] = chimp_trial_encode(*trials[k], source, nsample, nsample * 8);
+    }
+    size_t window = chimp_pick(sizes, CHIMP_NWINDOWS, policy);
+
+    // When the sample is the whole block, its trial already is the encoding.
+    ChimpN *encoder = trials[window];
+    uint32_t chimpsize = sizes[window];
+    if (nsample < nitems && chimpsize != UINT32_MAX)
+    {
+        encoder = &ctx->encoder(window, nitems);
+        if (seeded)
+            encoder->restore(*state);
+        chimpsize = chimp_trial_encode(*encoder, source, nitems, nitems * 8);
+    }
+
+    uint32_t candidates[2] = {nitems * 8, chimpsize};
+    uint8_t codec = chimp_pick(candidates, 2, policy) == 0 ? CHIMP_CODEC_RAW : CHIMP_CODEC_CHIMPN;
+
+    size_t bytesize = codec == CHIMP_CODEC_RAW ? candidates[0] : candidates[1];
+    if (bytesize > dst_size - CHIMP_HEADER_SIZE)
+        return ENCODING_BUFFER_TOO_SMALL;
+
+    char *writePos = dest;
+    *((uint32_t *)(writePos)) = nitems;
+    writePos += sizeof(uint32_t);
+    *writePos++ = codec;
+    *writePos++ = codec == CHIMP_CODEC_RAW ? 0 : CHIMP_WINDOWS[window].windowLog2;
+    *writePos++ = codec == CHIMP_CODEC_RAW ? 0 : CHIMP_WINDOWS[window].threshold;
+    *writePos++ = codec == CHIMP_CODEC_RAW ? 0 : CHIMP_FLAG_RUNS | (seeded ? CHIMP_FLAG_CONTINUATION : 0);
+
+    if (codec == CHIMP_CODEC_RAW)
+        memcpy(writePos, source, bytesize);
+    else
+        memcpy(writePos, encoder->getOut(), bytesize);
+    if (state != nullptr)
+        state->update(source, nitems);
+    return bytesize + CHIMP_HEADER_SIZE;
+}
+
+/*
+ * ret: -1    buffer overflow, fail to compress.
+ */
+inline int32_t
+chimp_compress_data(const char *source, uint32_t source_size,
+                    char *dest, uint32_t dst_size)
+{
+    return chimp_compress_data_ex(source, source_size, dest, dst_size, CHIMP_POLICY_SMALLEST, nullptr);
+}
+
+template <int WindowLog2>
+static uint32_t
+chimp_decode_window(const char *source, uint32_t source_size, uint32_t nitems, bool runs,
+                    const ChimpWindowState *seed, char *dest)
+{
+    ChimpNDecompressorT<WindowLog2> dm((uint8_t *)source, 1 << WindowLog2, nitems, runs, source_size);
+    if (seed != nullptr)
+        dm.restore(*seed);
+
+    return dm.getValues((double *)dest);
+}
+
+/*
+ * Decodes a ChimpN payload of source_size bytes with a decoder specialized to
+ * the windows CHIMP_WINDOWS can pick, and a generic one otherwise.
+ */
+static uint32_t
+chimp_decode_chimpn(const char *source, uint32_t source_size, uint32_t nitems, int windowLog2, bool runs,
+                    const ChimpWindowState *seed, char *dest)
+{
+    switch (windowLog2)
+    {
+    case 0:
+        return chimp_decode_window<0>(source, source_size, nitems, runs, seed, dest);
+    case 4:
+        return chimp_decode_window<4>(source, source_size, nitems, runs, seed, dest);
+    case 7:
+        return chimp_decode_window<7>(source, source_size, nitems, runs, seed, dest);
+    case 9:
+        return chimp_decode_window<9>(source, source_size, nitems, runs, seed, dest);
+    default:
+    {
+        ChimpNDecompressor dm((uint8_t *)source, 1 << windowLog2, nitems, runs, source_size);
+        if (seed != nullptr)
+            dm.restore(*seed);
+
+        return dm.getValues((double *)dest);
+    }
+    }
+}
+
+/*
+ * Decodes a block. Blocks flagged CHIMP_FLAG_CONTINUATION need the state left
+ * by the previous block of the series; with a state, it then moves on to the
+ * tail of this block.
+ *
+ * ret: the decompressed size, or a negative ENCODING_* error.
+ */
+inline int32_t
+chimp_decompress_data_ex(const char *source, uint32_t source_size, char *dest, uint32_t dest_size,
+                         ChimpWindowState *state)
+{
+    uint32_t nitems;
+    uint8_t codec;
+    uint8_t windowLog2;
+    uint8_t flags;
+
+    if (source_size < CHIMP_HEADER_SIZE)
+        return ENCODING_CORRUPTED_DATA;
+
+    nitems = *((uint32_t *)(source));
+    source += sizeof(uint32_t);
+    codec = *source++;
+    windowLog2 = *source++;
+    source++; // threshold only matters to the encoder
+    flags = *source++;
+
+    if ((uint64_t)nitems * 8 > dest_size)
+        return ENCODING_BUFFER_OVERFLOW;
+
+    switch (codec)
+    {
+    case CHIMP_CODEC_RAW:
+        if (source_size - CHIMP_HEADER_SIZE < (uint64_t)nitems * 8)
+            return ENCODING_CORRUPTED_DATA;
+        memcpy(dest, source, nitems * 8);
+        break;
+    case CHIMP_CODEC_CONSTANT:
+    {
+        uint32_t payload = source_size - CHIMP_HEADER_SIZE;
+        if (payload < sizeof(uint64_t) + sizeof(uint32_t))
+            return ENCODING_CORRUPTED_DATA;
+        uint64_t base = *((uint64_t *)(source));
+        uint32_t exceptions = *((uint32_t *)(source + sizeof(uint64_t)));
+        source += sizeof(uint64_t) + sizeof(uint32_t);
+        if ((payload - sizeof(uint64_t) - sizeof(uint32_t)) / CHIMP_EXCEPTION_SIZE < exceptions)
+            return ENCODING_CORRUPTED_DATA;
+
+        uint64_t *values = (uint64_t *)dest;
+        std::fill(values, values + nitems, base);
+        for (uint32_t i = 0; i < exceptions; i++, source += CHIMP_EXCEPTION_SIZE)
+        {
+            uint32_t position = *((uint32_t *)(source));
+            if (position >= nitems)
+                return ENCODING_CORRUPTED_DATA;
+            values[position] = *((uint64_t *)(source + sizeof(uint32_t)));
+        }
+        break;
+    }
+    case CHIMP_CODEC_CHIMPN:
+        if (windowLog2 > 16)
+            return ENCODING_CORRUPTED_DATA;
+        if ((flags & CHIMP_FLAG_CONTINUATION) && (state == nullptr || state->count == 0))
+            return ENCODING_MISSING_STATE;
+        if (chimp_decode_chimpn(source, source_size - CHIMP_HEADER_SIZE, nitems, windowLog2, flags & CHIMP_FLAG_RUNS,
+                                (flags & CHIMP_FLAG_CONTINUATION) ? state : nullptr, dest) != nitems)
+            return ENCODING_CORRUPTED_DATA;
+        break;
+    default:
+        return ENCODING_CORRUPTED_DATA;
+    }
+
+    if (state != nullptr)
+        state->update(dest, nitems);
+    return nitems * 8;
+}
+
+inline int32_t
+chimp_decompress_data(const char *source, uint32_t source_size, char *dest, uint32_t dest_size)
+{
+    return chimp_decompress_data_ex(source, source_size, dest, dest_size, nullptr);
+}
+
+/*
+ * A block stream is a sequence of blocks, each preceded by its compressed size
+ * as a uint32_t, so that blocks can be found without decoding them.
+ */
+#define CHIMP_FRAME_SIZE sizeof(uint32_t)
+
+/*
+ * Compresses nitems values and appends them to stream as one framed block.
+ * ret: the framed size, or a negative ENCODING_* error.
+ */
+inline int32_t
+chimp_append_block(std::vector<char> &stream, const char *source, uint32_t nitems)
+{
+    size_t offset = stream.size();
+    uint32_t bound = CHIMP_COMPRESS_BOUND(nitems * 8);
+
+    stream.resize(offset + CHIMP_FRAME_SIZE + bound);
+    int32_t size = chimp_compress_data(source, nitems * 8, stream.data() + offset + CHIMP_FRAME_SIZE, bound);
+    if (size < 0)
+    {
+        stream.resize(offset);
+        return size;
+    }
+    *((uint32_t *)(stream.data() + offset)) = size;
+    stream.resize(offset + CHIMP_FRAME_SIZE + size);
+    return size + CHIMP_FRAME_SIZE;
+}
+
+/*
+ * Decodes a whole block stream, appending the values to out.
+ * ret: the number of blocks, or a negative ENCODING_* error.
+ */
+inline int32_t
+chimp_decompress_stream(const char *stream, size_t size, std::vector<double> &out)
+{
+    const char *end = stream + size;
+    int32_t nblocks = 0;
+
+    while (stream < end)
+    {
+        if ((size_t)(end - stream) < CHIMP_FRAME_SIZE + CHIMP_HEADER_SIZE)
+            return ENCODING_CORRUPTED_DATA;
+        uint32_t blocksize = *((uint32_t *)(stream));
+        stream += CHIMP_FRAME_SIZE;
+        if (blocksize > (size_t)(end - stream) || blocksize < CHIMP_HEADER_SIZE)
+            return ENCODING_CORRUPTED_DATA;
+
+        uint32_t nitems = *((uint32_t *)(stream));
+        if ((uint64_t)nitems * 8 > UINT32_MAX)
+            return ENCODING_CORRUPTED_DATA;
+        size_t offset = out.size();
+        out.resize(offset + nitems);
+        int32_t ret = chimp_decompress_data(stream, blocksize, (char *)(out.data() + offset), nitems * 8);
+        if (ret < 0)
+            return ret;
+        stream += blocksize;
+        nblocks++;
+    }
+    return nblocks;
+}
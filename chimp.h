@@ -339,10 +339,14 @@ struct InputBitStream
      * <P>However, this method does <em>not</em> update {@link #readBits}.
      * The caller should increment {@link #readBits} by 8 at each call, unless
      * the bit are used to load {@link #current}.
+     *
+     * <P>Past the {@link #avail} bytes of the buffer, it returns zeros.
      */
 
     int read()
     {
+        if (avail <= 0)
+            return 0;
         avail--;
         return buffer[pos++] & 0xFF;
     }
@@ -0,0 +1,161 @@
+#include "ChimpColumnFile.cpp"
+#include "CSVReader-mmap.cpp"
+#include <iostream>
+#include <chrono>
+#include <charconv>
+#include <cstdlib>
+using namespace std::chrono;
+using namespace std;
+
+static void usage()
+{
+    cout << "usage: csv2chimp input.csv output.chimpc [-H] [-c col,col,...] [-n rows]" << endl;
+    cout << "       csv2chimp -l file.chimpc" << endl;
+    cout << "       csv2chimp -x file.chimpc column" << endl;
+}
+
+static bool isNumber(const string &field)
+{
+    const char *p = field.data();
+    const char *end = p + field.size();
+    while (p < end && *p == ' ')
+        p++;
+    if (p < end && *p == '+')
+        p++;
+    double value;
+    auto result = from_chars(p, end, value);
+    return result.ec == errc() && (result.ptr == end || *result.ptr == '\r');
+}
+
+static int list(const char *filename)
+{
+    ChimpColumnReader reader(filename);
+    if (!reader.valid) {
+        cout << "not a columnar chimp file: " << filename << endl;
+        return -1;
+    }
+    cout << "rowgroups: " << reader.rowgroups.size() << endl;
+    for (size_t c = 0; c < reader.ncols(); c++) {
+        const ChimpColumnStats &s = reader.stats[c];
+        uint64_t n = s.nvalues - s.nnan;
+        cout << reader.names[c] << ": values " << s.nvalues << " nan " << s.nnan
+             << " min " << s.min << " max " << s.max << " mean " << (n > 0 ? s.sum / n : NAN)
+             << " bytes " << s.bytes << " compressed_rate " << s.bytes * 1.0 / (s.nvalues * 8) << endl;
+    }
+    return 0;
+}
+
+static int extract(const char *filename, const string &name)
+{
+    ChimpColumnReader reader(filename);
+    if (!reader.valid) {
+        cout << "not a columnar chimp file: " << filename << endl;
+        return -1;
+    }
+    int c = reader.column(name);
+    if (c < 0) {
+        cout << "no column " << name << endl;
+        return -1;
+    }
+    vector<double> values(reader.stats[c].nvalues);
+    if (reader.readColumn(c, values.data()) < 0) {
+        cout << "corrupted column " << name << endl;
+        return -1;
+    }
+    cout.precision(17);
+    for (double v : values)
+        cout << v << "\n";
+    return 0;
+}
+
+/*
+ * Converts the numeric columns of a CSV file into a columnar chimp file in one
+ * pass: every row group of up to -n rows is parsed into one buffer per column
+ * and each column buffer is compressed into its own block.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc >= 3 && string(argv[1]) == "-l")
+        return list(argv[2]);
+    if (argc >= 4 && string(argv[1]) == "-x")
+        return extract(argv[2], argv[3]);
+    if (argc < 3) {
+        usage();
+        return -1;
+    }
+
+    bool header = false;
+    vector<size_t> cols;
+    uint32_t rows = 3600;
+    for (int i = 3; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg == "-H") {
+            header = true;
+        } else if (arg == "-c" && i + 1 < argc) {
+            for (char *p = argv[++i]; *p != '\0';) {
+                cols.push_back(strtoul(p, &p, 10));
+                if (*p == ',')
+                    p++;
+            }
+        } else if (arg == "-n" && i + 1 < argc) {
+            rows = atoi(argv[++i]);
+        } else {
+            usage();
+            return -1;
+        }
+    }
+
+    CSVReader reader(argv[1]);
+    vector<string> names = header ? reader.nextFields() : vector<string>();
+    if (cols.empty()) {
+        // Take every field of the first row that parses as a number.
+        CSVReader probe(argv[1]);
+        if (header)
+            probe.nextFields();
+        vector<string> first = probe.nextFields();
+        for (size_t c = 0; c < first.size(); c++)
+            if (isNumber(first[c]))
+                cols.push_back(c);
+    }
+    sort(cols.begin(), cols.end());
+    cols.erase(unique(cols.begin(), cols.end()), cols.end());
+    if (cols.empty() || rows == 0) {
+        cout << "no numeric columns" << endl;
+        return -1;
+    }
+
+    vector<string> selected;
+    for (size_t c : cols)
+        selected.push_back(c < names.size() ? names[c] : "col" + to_string(c));
+
+    ChimpColumnWriter writer(argv[2], selected);
+    if (!writer.good()) {
+        cout << "Unable to open file " << argv[2] << endl;
+        return -1;
+    }
+
+    vector<vector<double>> buffers(cols.size(), vector<double>(rows));
+    vector<double *> outs;
+    for (auto &b : buffers)
+        outs.push_back(b.data());
+
+    auto starttime = steady_clock::now();
+    uint64_t total = 0;
+    size_t n;
+    while ((n = reader.nextRows(cols.data(), cols.size(), outs.data(), rows)) != 0) {
+        if (!writer.addRowGroup(outs.data(), n)) {
+            cout << "write failed" << endl;
+            return -1;
+        }
+        total += n;
+    }
+    if (!writer.close()) {
+        cout << "write failed" << endl;
+        return -1;
+    }
+    duration<double> diff = steady_clock::now() - starttime;
+
+    cout << "rows: " << total << " columns: " << cols.size() << " time: " << diff.count() << "s "
+         << reader.mappingSize() / diff.count() / 1e6 << " MB/s" << endl;
+    return list(argv[2]);
+}
@@ -1,7 +1,11 @@
 #include <vector>
 #include <cmath>
 #include <string>
-#include "CSVReader-advanced.cpp"
+// Build with -DCSVREADER='"CSVReader-mmap.cpp"' to try another reader.
+#ifndef CSVREADER
+#define CSVREADER "CSVReader-advanced.cpp"
+#endif
+#include CSVREADER
 #include <iostream>
 #include <iomanip>
 #include <fstream>
@@ -71,13 +75,51 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <chrono>
 using namespace std;
 
+/*
+ * Times loading the whole column, through isEmpty()/nextLine() and, for
+ * readers that have it, through nextBatch().
+ */
+template <typename Reader>
+auto benchRead(Reader &reader, int) -> decltype(reader.nextBatch(nullptr, 0))
+{
+    std::vector<double> batch(4096);
+    size_t n, total = 0;
+    while ((n = reader.nextBatch(batch.data(), batch.size())) != 0)
+        total += n;
+    return total;
+}
+
+template <typename Reader>
+size_t benchRead(Reader &reader, long)
+{
+    size_t total = 0;
+    while (!reader.isEmpty())
+    {
+        reader.nextLine();
+        total++;
+    }
+    return total;
+}
+
 int main(int argc, char *argv[])
 {
     std::string filename(argv[1]);
     // int skip_timestamp = argc > 2;
 
+    if (argc > 2 && std::string(argv[2]) == "--bench")
+    {
+        CSVReader reader(filename);
+        auto starttime = std::chrono::steady_clock::now();
+        size_t total = benchRead(reader, 0);
+        std::chrono::duration<double> diff = std::chrono::steady_clock::now() - starttime;
+        std::cout << "Lines = " << total << " in " << diff.count() << "s, "
+                  << total / diff.count() / 1e6 << " Mvalues/s" << std::endl;
+        return 0;
+    }
+
     CSVReader reader(filename);
 
     uint64_t nlines = 0;